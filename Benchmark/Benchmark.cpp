@@ -0,0 +1,163 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Snowflake/Snowflake.hpp"
+
+// Probe length and lookup benchmark for SnowID keyed maps.
+// Compares the old std::hash<SnowID> (XOR of both halves, std::hash<uint64_t> being
+// the identity function on libstdc++) against SnowID::Hash on typical GUID sets.
+namespace
+{
+	struct LegacySnowIDHash
+	{
+		size_t operator()(const SnowID& id) const
+		{
+			return static_cast<size_t>(id.loPart ^ id.hiPart);
+		}
+	};
+
+	struct GuidSet
+	{
+		std::string name;
+		std::vector<SnowID> ids;
+	};
+
+	// Version 4 GUIDs as returned by CoCreateGuid.
+	std::vector<SnowID> MakeRandomGuids(size_t count)
+	{
+		std::mt19937_64 rng(1337);
+		std::vector<SnowID> ids;
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint64_t hi = (rng() & ~0xF000000000000000ull) | 0x4000000000000000ull;
+			uint64_t lo = (rng() & ~0xC0ull) | 0x80ull;
+			ids.emplace_back(hi, lo);
+		}
+		return ids;
+	}
+
+	// Version 1 GUIDs as returned by UuidCreateSequential, only the time field changes.
+	std::vector<SnowID> MakeSequentialGuids(size_t count)
+	{
+		std::vector<SnowID> ids;
+		for (size_t i = 0; i < count; ++i)
+		{
+			ids.push_back(SnowID::Construct(0x8C3B5A10u + static_cast<uint32_t>(i), 0xE4F1, 0x11ED, 0xA1, 0x2B, 0x00, 0x15, 0x5D, 0x64, 0x7A, 0x01));
+		}
+		return ids;
+	}
+
+	// Hand authored catalog GUIDs that bump the first and last group together.
+	std::vector<SnowID> MakeAuthoredGuids(size_t count)
+	{
+		std::vector<SnowID> ids;
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint8_t lo = static_cast<uint8_t>(i);
+			uint8_t hi = static_cast<uint8_t>(i >> 8);
+			ids.push_back(SnowID::Construct(0x4A340000u | static_cast<uint32_t>(i), 0xA5EC, 0x400F, hi, lo, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00));
+		}
+		return ids;
+	}
+
+	// IDs built from the same counter in both halves, the worst case for the XOR hash.
+	std::vector<SnowID> MakeMirroredGuids(size_t count)
+	{
+		std::vector<SnowID> ids;
+		for (size_t i = 0; i < count; ++i)
+		{
+			ids.emplace_back(0x1000 + i, 0x1000 + i);
+		}
+		return ids;
+	}
+
+	template<class THash>
+	size_t CountDistinctHashes(const std::vector<SnowID>& ids)
+	{
+		std::unordered_set<uint64_t> hashes;
+		for (auto& id : ids)
+		{
+			hashes.insert(THash()(id));
+		}
+		return hashes.size();
+	}
+
+	template<class TMap>
+	double MeasureLookup(TMap& map, const std::vector<SnowID>& ids)
+	{
+		// Repeat whole rounds for at least 20 ms, degenerate sets get away with a single round.
+		size_t sum = 0;
+		size_t rounds = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		auto end = start;
+		while (end - start < std::chrono::milliseconds(20))
+		{
+			for (auto& id : ids)
+			{
+				sum += map.find(id)->second;
+			}
+			++rounds;
+			end = std::chrono::high_resolution_clock::now();
+		}
+		if (sum == 0) printf(" ");
+		return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(rounds * ids.size());
+	}
+
+	template<class THash>
+	size_t MaxBucketSize(const std::unordered_map<SnowID, size_t, THash>& map)
+	{
+		size_t maxSize = 0;
+		for (size_t i = 0; i < map.bucket_count(); ++i)
+		{
+			maxSize = std::max(maxSize, map.bucket_size(i));
+		}
+		return maxSize;
+	}
+
+	void RunSet(const GuidSet& set)
+	{
+		Snowflake::FlatMap<SnowID, size_t, LegacySnowIDHash> legacyFlat;
+		Snowflake::FlatMap<SnowID, size_t> flat;
+		std::unordered_map<SnowID, size_t, LegacySnowIDHash> legacyNode;
+		std::unordered_map<SnowID, size_t> node;
+		for (size_t i = 0; i < set.ids.size(); ++i)
+		{
+			legacyFlat[set.ids[i]] = i + 1;
+			flat[set.ids[i]] = i + 1;
+			legacyNode[set.ids[i]] = i + 1;
+			node[set.ids[i]] = i + 1;
+		}
+
+		auto legacyStats = legacyFlat.GetProbeStats();
+		auto stats = flat.GetProbeStats();
+		printf("%s (%zu ids)\n", set.name.c_str(), set.ids.size());
+		printf("  %-8s distinct hashes %7zu  flat probe avg %7.2f max %5zu  node max bucket %5zu  flat %6.1f ns  node %6.1f ns\n", "legacy",
+			CountDistinctHashes<LegacySnowIDHash>(set.ids), legacyStats.averageProbeLength, legacyStats.maxProbeLength, MaxBucketSize(legacyNode),
+			MeasureLookup(legacyFlat, set.ids), MeasureLookup(legacyNode, set.ids));
+		printf("  %-8s distinct hashes %7zu  flat probe avg %7.2f max %5zu  node max bucket %5zu  flat %6.1f ns  node %6.1f ns\n", "snowid",
+			CountDistinctHashes<std::hash<SnowID>>(set.ids), stats.averageProbeLength, stats.maxProbeLength, MaxBucketSize(node),
+			MeasureLookup(flat, set.ids), MeasureLookup(node, set.ids));
+	}
+}
+
+int main()
+{
+	for (size_t count : { size_t(256), size_t(16384) })
+	{
+		std::vector<GuidSet> sets = {
+			{ "random v4", MakeRandomGuids(count) },
+			{ "sequential v1", MakeSequentialGuids(count) },
+			{ "authored", MakeAuthoredGuids(count) },
+			{ "mirrored counters", MakeMirroredGuids(count) },
+		};
+		for (auto& set : sets)
+		{
+			RunSet(set);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include "Snowflake/Memory.hpp"
+#include "Snowflake/TraceReplayer.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Replays a trace captured with Registry::SetTraceRecorder against a fresh registry and
+// reports throughput, per operation latency percentiles, component memory and the peak memory of the process.
+// Usage: Replay <trace file> [--pages]
+//   --pages  allocates the component pools from a PageResource instead of the global heap
+namespace
+{
+	constexpr size_t OpCount = static_cast<size_t>(Snowflake::TraceOp::Execute) + 1;
+	constexpr std::array<const char*, OpCount> OpNames = {
+		"DefineComponent",
+		"CreateEntity",
+		"DestroyEntity",
+		"DestroyHierarchy",
+		"AddComponent",
+		"RemoveComponent",
+		"SetParent",
+		"Execute",
+	};
+
+	size_t PeakMemoryUsage()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters{};
+		GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+		return counters.PeakWorkingSetSize;
+#else
+		rusage usage{};
+		getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+		return static_cast<size_t>(usage.ru_maxrss);
+#else
+		return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+	}
+
+	double Percentile(const std::vector<double>& sorted, double percentile)
+	{
+		size_t index = static_cast<size_t>(percentile / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+		return sorted[index];
+	}
+
+	void PrintLatencies(const char* name, std::vector<double>& latencies)
+	{
+		if (latencies.empty()) return;
+		std::sort(latencies.begin(), latencies.end());
+		printf("%-18s %10zu %10.0f %10.0f %10.0f %10.0f %10.0f\n", name, latencies.size(),
+			Percentile(latencies, 50.0), Percentile(latencies, 90.0), Percentile(latencies, 99.0), Percentile(latencies, 99.9), latencies.back());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <trace file> [--pages]\n", argv[0]);
+		return 1;
+	}
+	const bool usePages = argc > 2 && strcmp(argv[2], "--pages") == 0;
+
+	std::ifstream readFile(argv[1], std::ios::in | std::ios::binary);
+	if (!readFile)
+	{
+		printf("Could not open %s\n", argv[1]);
+		return 1;
+	}
+	std::vector<uint8_t> trace((std::istreambuf_iterator<char>(readFile)), std::istreambuf_iterator<char>());
+
+	// Decode up front so parsing is not part of the measured time.
+	Snowflake::TraceReader reader(trace.data(), trace.size());
+	std::vector<Snowflake::TraceEvent> events;
+	Snowflake::TraceEvent event;
+	while (reader.Next(event))
+	{
+		events.push_back(event);
+	}
+	if (!reader.IsValid())
+	{
+		printf("Trace is malformed after %zu events\n", events.size());
+		return 1;
+	}
+
+	const size_t baseMemory = PeakMemoryUsage();
+	std::array<std::vector<double>, OpCount> latencies;
+	size_t failures = 0;
+	double totalTime = 0.0;
+	{
+		Snowflake::PageResource pages;
+		Snowflake::Registry registry(usePages ? static_cast<std::pmr::memory_resource*>(&pages) : std::pmr::get_default_resource());
+		Snowflake::TraceReplayer replayer(registry);
+		for (auto& replayEvent : events)
+		{
+			auto start = std::chrono::steady_clock::now();
+			bool applied = replayer.Apply(replayEvent, reader);
+			auto end = std::chrono::steady_clock::now();
+			double nanoseconds = std::chrono::duration<double, std::nano>(end - start).count();
+			latencies[static_cast<size_t>(replayEvent.op)].push_back(nanoseconds);
+			totalTime += nanoseconds;
+			failures += applied ? 0 : 1;
+		}
+		printf("Replayed %zu events (%zu component types, %zu failed, checksum %llu)\n", events.size(), reader.GetComponentCount(), failures,
+			static_cast<unsigned long long>(replayer.GetChecksum()));
+		auto usage = registry.GetMemoryUsage();
+		printf("Component memory %.2f MiB allocated, %.2f MiB used by %zu components\n", usage.allocatedBytes / (1024.0 * 1024.0),
+			usage.usedBytes / (1024.0 * 1024.0), usage.componentCount);
+		if (usePages)
+		{
+			printf("Pages %.2f MiB mapped, %.2f MiB in huge pages\n", pages.GetMappedBytes() / (1024.0 * 1024.0), pages.GetHugePageBytes() / (1024.0 * 1024.0));
+		}
+	}
+
+	printf("Total %.3f ms, %.0f ops/s\n", totalTime / 1e6, totalTime > 0.0 ? static_cast<double>(events.size()) / (totalTime / 1e9) : 0.0);
+	printf("Peak memory %.2f MiB (%.2f MiB before replay)\n", PeakMemoryUsage() / (1024.0 * 1024.0), baseMemory / (1024.0 * 1024.0));
+	printf("%-18s %10s %10s %10s %10s %10s %10s\n", "latency (ns)", "count", "p50", "p90", "p99", "p99.9", "max");
+	std::vector<double> all;
+	for (size_t op = 0; op < OpCount; ++op)
+	{
+		all.insert(all.end(), latencies[op].begin(), latencies[op].end());
+		PrintLatencies(OpNames[op], latencies[op]);
+	}
+	PrintLatencies("All", all);
+	return failures == 0 ? 0 : 2;
+}
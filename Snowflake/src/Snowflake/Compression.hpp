@@ -0,0 +1,402 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace Snowflake
+{
+	// Reversible transform run on each block before compression. Both compare every byte
+	// with the byte stride positions earlier, which turns columns of similar values in
+	// fixed size records into runs of zeros.
+	enum class CompressionFilter : uint8_t
+	{
+		None,
+		Delta,
+		Xor
+	};
+
+	struct CompressionSettings
+	{
+		CompressionFilter filter = CompressionFilter::None;
+		// Distance in bytes between two values of the same column, 0 lets the serializer pick the record size.
+		uint32_t stride = 0;
+		uint32_t blockSize = 64 * 1024;
+		// 0 uses one thread per hardware thread.
+		uint32_t threadCount = 0;
+	};
+
+	// Splits a buffer into independent blocks, each LZ compressed and checksummed with CRC32,
+	// so blocks are compressed and decompressed in parallel and corrupted data is rejected.
+	//
+	// Layout: magic, version, filter, stride, block size, raw size, block count,
+	// a {raw size, stored size, crc, flags} entry per block, a CRC32 of everything
+	// before it and then the block payloads back to back.
+	class BlockCompression
+	{
+	public:
+		static constexpr uint64_t Magic = 0x314B4C42574F4E53ull; // "SNOWBLK1"
+		static constexpr uint32_t Version = 1;
+
+		static bool IsCompressed(const uint8_t* data, size_t size)
+		{
+			uint64_t magic = 0;
+			if (size < sizeof(magic)) return false;
+			memcpy(&magic, data, sizeof(magic));
+			return magic == Magic;
+		}
+
+		static std::vector<uint8_t> Compress(const uint8_t* data, size_t size, const CompressionSettings& settings)
+		{
+			const uint32_t blockSize = std::max<uint32_t>(settings.blockSize, 1);
+			const uint32_t blockCount = static_cast<uint32_t>((size + blockSize - 1) / blockSize);
+			const uint32_t stride = settings.filter == CompressionFilter::None ? 0 : std::max<uint32_t>(settings.stride, 1);
+
+			std::vector<BlockEntry> entries(blockCount);
+			std::vector<std::vector<uint8_t>> payloads(blockCount);
+			ParallelFor(blockCount, settings.threadCount, [&](size_t i)
+				{
+					const uint8_t* block = data + i * blockSize;
+					const uint32_t rawSize = static_cast<uint32_t>(std::min<size_t>(blockSize, size - i * blockSize));
+					std::vector<uint8_t> filtered(block, block + rawSize);
+					ApplyFilter(settings.filter, stride, filtered.data(), rawSize);
+
+					auto& payload = payloads[i];
+					payload.resize(static_cast<size_t>(rawSize) + rawSize / 255 + 16);
+					size_t storedSize = LZCompress(filtered.data(), rawSize, payload.data(), payload.size());
+					auto& entry = entries[i];
+					entry.rawSize = rawSize;
+					entry.crc = Crc32(block, rawSize);
+					if (storedSize == 0 || storedSize >= rawSize)
+					{
+						payload = std::move(filtered);
+						entry.storedSize = rawSize;
+						entry.flags = 0;
+					}
+					else
+					{
+						payload.resize(storedSize);
+						entry.storedSize = static_cast<uint32_t>(storedSize);
+						entry.flags = LZFlag;
+					}
+				});
+
+			std::vector<uint8_t> output;
+			Write(output, Magic);
+			Write(output, Version);
+			Write(output, static_cast<uint32_t>(settings.filter));
+			Write(output, stride);
+			Write(output, blockSize);
+			Write(output, static_cast<uint64_t>(size));
+			Write(output, blockCount);
+			for (auto& entry : entries)
+			{
+				Write(output, entry.rawSize);
+				Write(output, entry.storedSize);
+				Write(output, entry.crc);
+				Write(output, entry.flags);
+			}
+			Write(output, Crc32(output.data(), output.size()));
+			for (auto& payload : payloads)
+			{
+				output.insert(output.end(), payload.begin(), payload.end());
+			}
+			return output;
+		}
+
+		// Returns false if the data is truncated, malformed or fails a checksum.
+		static bool Decompress(const uint8_t* data, size_t size, std::vector<uint8_t>& output, uint32_t threadCount = 0)
+		{
+			size_t offset = 0;
+			uint64_t magic = 0;
+			uint32_t version = 0;
+			uint32_t filter = 0;
+			uint32_t stride = 0;
+			uint32_t blockSize = 0;
+			uint64_t rawSize = 0;
+			uint32_t blockCount = 0;
+			if (!Read(data, size, offset, magic) || magic != Magic) return false;
+			if (!Read(data, size, offset, version) || version != Version) return false;
+			if (!Read(data, size, offset, filter) || filter > static_cast<uint32_t>(CompressionFilter::Xor)) return false;
+			if (!Read(data, size, offset, stride)) return false;
+			if (!Read(data, size, offset, blockSize) || blockSize == 0) return false;
+			if (!Read(data, size, offset, rawSize)) return false;
+			if (!Read(data, size, offset, blockCount)) return false;
+			if ((rawSize + blockSize - 1) / blockSize != blockCount) return false;
+			if (static_cast<uint64_t>(blockCount) * sizeof(BlockEntry) > size - offset) return false;
+
+			std::vector<BlockEntry> entries(blockCount);
+			std::vector<size_t> payloadOffsets(blockCount);
+			for (auto& entry : entries)
+			{
+				Read(data, size, offset, entry.rawSize);
+				Read(data, size, offset, entry.storedSize);
+				Read(data, size, offset, entry.crc);
+				Read(data, size, offset, entry.flags);
+			}
+			uint32_t headerCrc = 0;
+			const size_t headerSize = offset;
+			if (!Read(data, size, offset, headerCrc) || headerCrc != Crc32(data, headerSize)) return false;
+
+			for (uint32_t i = 0; i < blockCount; ++i)
+			{
+				const uint64_t expectedSize = std::min<uint64_t>(blockSize, rawSize - static_cast<uint64_t>(i) * blockSize);
+				if (entries[i].rawSize != expectedSize || entries[i].storedSize > size - offset) return false;
+				payloadOffsets[i] = offset;
+				offset += entries[i].storedSize;
+			}
+
+			output.resize(static_cast<size_t>(rawSize));
+			std::vector<uint8_t> results(blockCount, 0);
+			ParallelFor(blockCount, threadCount, [&](size_t i)
+				{
+					const auto& entry = entries[i];
+					uint8_t* block = output.data() + i * blockSize;
+					const uint8_t* payload = data + payloadOffsets[i];
+					if (entry.flags & LZFlag)
+					{
+						if (!LZDecompress(payload, entry.storedSize, block, entry.rawSize)) return;
+					}
+					else
+					{
+						if (entry.storedSize != entry.rawSize) return;
+						memcpy(block, payload, entry.rawSize);
+					}
+					RemoveFilter(static_cast<CompressionFilter>(filter), stride, block, entry.rawSize);
+					results[i] = Crc32(block, entry.rawSize) == entry.crc;
+				});
+			return std::all_of(results.begin(), results.end(), [](uint8_t result) { return result != 0; });
+		}
+
+		static uint32_t Crc32(const uint8_t* data, size_t size)
+		{
+			static const std::array<uint32_t, 256> table = []
+			{
+				std::array<uint32_t, 256> result{};
+				for (uint32_t i = 0; i < 256; ++i)
+				{
+					uint32_t crc = i;
+					for (int bit = 0; bit < 8; ++bit)
+					{
+						crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+					}
+					result[i] = crc;
+				}
+				return result;
+			}();
+
+			uint32_t crc = ~0u;
+			for (size_t i = 0; i < size; ++i)
+			{
+				crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+
+	private:
+		struct BlockEntry
+		{
+			uint32_t rawSize = 0;
+			uint32_t storedSize = 0;
+			uint32_t crc = 0;
+			uint32_t flags = 0;
+		};
+
+		static constexpr uint32_t LZFlag = 1;
+		static constexpr size_t MinMatch = 4;
+		static constexpr size_t MaxOffset = 0xFFFF;
+		static constexpr uint32_t HashBits = 14;
+
+		template<typename T>
+		static void Write(std::vector<uint8_t>& output, T value)
+		{
+			size_t offset = output.size();
+			output.resize(offset + sizeof(T));
+			memcpy(output.data() + offset, &value, sizeof(T));
+		}
+
+		template<typename T>
+		static bool Read(const uint8_t* data, size_t size, size_t& offset, T& value)
+		{
+			if (size - offset < sizeof(T)) return false;
+			memcpy(&value, data + offset, sizeof(T));
+			offset += sizeof(T);
+			return true;
+		}
+
+		static void ApplyFilter(CompressionFilter filter, uint32_t stride, uint8_t* data, size_t size)
+		{
+			if (filter == CompressionFilter::None) return;
+			for (size_t i = size; i-- > stride;)
+			{
+				data[i] = filter == CompressionFilter::Delta ? static_cast<uint8_t>(data[i] - data[i - stride]) : static_cast<uint8_t>(data[i] ^ data[i - stride]);
+			}
+		}
+
+		static void RemoveFilter(CompressionFilter filter, uint32_t stride, uint8_t* data, size_t size)
+		{
+			if (filter == CompressionFilter::None) return;
+			for (size_t i = stride; i < size; ++i)
+			{
+				data[i] = filter == CompressionFilter::Delta ? static_cast<uint8_t>(data[i] + data[i - stride]) : static_cast<uint8_t>(data[i] ^ data[i - stride]);
+			}
+		}
+
+		// Lengths of 15 or more continue in extra bytes, each 255 means another byte follows.
+		static bool WriteLength(uint8_t* dst, size_t capacity, size_t& op, size_t length)
+		{
+			for (length -= 15; length >= 255; length -= 255)
+			{
+				if (op >= capacity) return false;
+				dst[op++] = 255;
+			}
+			if (op >= capacity) return false;
+			dst[op++] = static_cast<uint8_t>(length);
+			return true;
+		}
+
+		static bool ReadLength(const uint8_t* src, size_t size, size_t& ip, size_t& length)
+		{
+			uint8_t value = 0;
+			do
+			{
+				if (ip >= size) return false;
+				value = src[ip++];
+				length += value;
+			} while (value == 255);
+			return true;
+		}
+
+		// LZ77 with a single entry hash table and LZ4 style sequences:
+		// token (literal length << 4 | match length - 4), literals, 16 bit offset.
+		// The last sequence has literals only. Returns 0 if the output does not fit.
+		static size_t LZCompress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity)
+		{
+			std::vector<uint32_t> table(size_t(1) << HashBits, ~0u);
+			size_t ip = 0;
+			size_t anchor = 0;
+			size_t op = 0;
+
+			auto emit = [&](size_t literals, size_t offset, size_t matchLength) -> bool
+			{
+				if (op >= capacity) return false;
+				size_t token = op++;
+				dst[token] = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+				if (literals >= 15 && !WriteLength(dst, capacity, op, literals)) return false;
+				if (literals > capacity - op) return false;
+				memcpy(dst + op, src + anchor, literals);
+				op += literals;
+				if (matchLength == 0) return true;
+
+				if (capacity - op < 2) return false;
+				dst[op++] = static_cast<uint8_t>(offset);
+				dst[op++] = static_cast<uint8_t>(offset >> 8);
+				dst[token] |= static_cast<uint8_t>(std::min<size_t>(matchLength - MinMatch, 15));
+				return matchLength - MinMatch < 15 || WriteLength(dst, capacity, op, matchLength - MinMatch);
+			};
+
+			while (size >= MinMatch && ip <= size - MinMatch)
+			{
+				uint32_t sequence;
+				memcpy(&sequence, src + ip, sizeof(sequence));
+				uint32_t hash = (sequence * 2654435761u) >> (32 - HashBits);
+				uint32_t candidate = table[hash];
+				table[hash] = static_cast<uint32_t>(ip);
+				if (candidate != ~0u && ip - candidate <= MaxOffset && memcmp(src + candidate, src + ip, MinMatch) == 0)
+				{
+					size_t length = MinMatch;
+					while (ip + length < size && src[candidate + length] == src[ip + length])
+					{
+						++length;
+					}
+					if (!emit(ip - anchor, ip - candidate, length)) return 0;
+					ip += length;
+					anchor = ip;
+				}
+				else
+				{
+					++ip;
+				}
+			}
+			if (!emit(size - anchor, 0, 0)) return 0;
+			return op;
+		}
+
+		static bool LZDecompress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity)
+		{
+			size_t ip = 0;
+			size_t op = 0;
+			while (ip < size)
+			{
+				const uint8_t token = src[ip++];
+				size_t literals = token >> 4;
+				if (literals == 15 && !ReadLength(src, size, ip, literals)) return false;
+				if (literals > size - ip || literals > capacity - op) return false;
+				memcpy(dst + op, src + ip, literals);
+				ip += literals;
+				op += literals;
+				if (ip == size) break;
+
+				if (size - ip < 2) return false;
+				const size_t offset = src[ip] | (static_cast<size_t>(src[ip + 1]) << 8);
+				ip += 2;
+				size_t length = token & 15;
+				if (length == 15 && !ReadLength(src, size, ip, length)) return false;
+				length += MinMatch;
+				if (offset == 0 || offset > op || length > capacity - op) return false;
+
+				const uint8_t* match = dst + op - offset;
+				if (offset >= length)
+				{
+					memcpy(dst + op, match, length);
+				}
+				else
+				{
+					for (size_t i = 0; i < length; ++i)
+					{
+						dst[op + i] = match[i];
+					}
+				}
+				op += length;
+			}
+			return op == capacity;
+		}
+
+		template<class TFunction>
+		static void ParallelFor(size_t count, uint32_t threadCount, TFunction&& func)
+		{
+			size_t workers = threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+			workers = std::min(workers, count);
+			if (workers <= 1)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					func(i);
+				}
+				return;
+			}
+
+			std::atomic<size_t> next{ 0 };
+			auto work = [&]()
+			{
+				for (size_t i = next++; i < count; i = next++)
+				{
+					func(i);
+				}
+			};
+			std::vector<std::thread> threads;
+			for (size_t i = 1; i < workers; ++i)
+			{
+				threads.emplace_back(work);
+			}
+			work();
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+		}
+	};
+}
@@ -0,0 +1,304 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace Snowflake
+{
+	struct ProbeStats
+	{
+		size_t size = 0;
+		size_t capacity = 0;
+		double averageProbeLength = 0.0;
+		size_t maxProbeLength = 0;
+	};
+
+	// Open addressing hash map using robin hood linear probing with backward shift erase.
+	// Keys and values are stored inline in one array, so a lookup touches a few adjacent
+	// slots instead of chasing bucket nodes. Inserting or erasing invalidates iterators and
+	// references to elements, values themselves are moved when the table grows.
+	template<class TKey, class TValue, class THash = std::hash<TKey>>
+	class FlatMap
+	{
+	public:
+		using value_type = std::pair<TKey, TValue>;
+
+		template<bool IsConst>
+		class Iterator
+		{
+			friend class FlatMap;
+			using MapType = std::conditional_t<IsConst, const FlatMap, FlatMap>;
+			using Reference = std::conditional_t<IsConst, const value_type&, value_type&>;
+			using Pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+		public:
+			Iterator(MapType* map, size_t index) : m_Map(map), m_Index(index)
+			{
+				SkipEmpty();
+			}
+
+			Reference operator*() const { return m_Map->m_Slots[m_Index]; }
+			Pointer operator->() const { return &m_Map->m_Slots[m_Index]; }
+
+			Iterator& operator++()
+			{
+				++m_Index;
+				SkipEmpty();
+				return *this;
+			}
+
+			bool operator==(const Iterator& rhs) const { return m_Index == rhs.m_Index; }
+			bool operator!=(const Iterator& rhs) const { return m_Index != rhs.m_Index; }
+		private:
+			void SkipEmpty()
+			{
+				while (m_Index < m_Map->m_Capacity && m_Map->m_Distances[m_Index] == 0)
+				{
+					++m_Index;
+				}
+			}
+
+			MapType* m_Map;
+			size_t m_Index;
+		};
+
+		using iterator = Iterator<false>;
+		using const_iterator = Iterator<true>;
+
+		FlatMap() = default;
+
+		FlatMap(const FlatMap& other)
+		{
+			reserve(other.m_Size);
+			for (auto& value : other)
+			{
+				Insert(value_type(value));
+			}
+		}
+
+		FlatMap(FlatMap&& other) noexcept
+		{
+			Swap(other);
+		}
+
+		FlatMap& operator=(FlatMap other) noexcept
+		{
+			Swap(other);
+			return *this;
+		}
+
+		~FlatMap()
+		{
+			Release();
+		}
+
+		iterator begin() { return iterator(this, 0); }
+		iterator end() { return iterator(this, m_Capacity); }
+		const_iterator begin() const { return const_iterator(this, 0); }
+		const_iterator end() const { return const_iterator(this, m_Capacity); }
+
+		size_t size() const { return m_Size; }
+		bool empty() const { return m_Size == 0; }
+
+		iterator find(const TKey& key)
+		{
+			size_t index = FindIndex(key);
+			return iterator(this, index == NotFound ? m_Capacity : index);
+		}
+
+		const_iterator find(const TKey& key) const
+		{
+			size_t index = FindIndex(key);
+			return const_iterator(this, index == NotFound ? m_Capacity : index);
+		}
+
+		size_t count(const TKey& key) const
+		{
+			return FindIndex(key) == NotFound ? 0 : 1;
+		}
+
+		TValue& operator[](const TKey& key)
+		{
+			size_t index = FindIndex(key);
+			if (index == NotFound)
+			{
+				Insert(value_type(key, TValue()));
+				index = FindIndex(key);
+			}
+			return m_Slots[index].second;
+		}
+
+		size_t erase(const TKey& key)
+		{
+			size_t index = FindIndex(key);
+			if (index == NotFound) return 0;
+
+			// Backward shift, pull every displaced successor one slot closer to its home.
+			m_Slots[index].~value_type();
+			m_Distances[index] = 0;
+			--m_Size;
+			size_t next = (index + 1) & m_Mask;
+			while (m_Distances[next] > 1)
+			{
+				new (&m_Slots[index]) value_type(std::move(m_Slots[next]));
+				m_Slots[next].~value_type();
+				m_Distances[index] = m_Distances[next] - 1;
+				m_Distances[next] = 0;
+				index = next;
+				next = (next + 1) & m_Mask;
+			}
+			return 1;
+		}
+
+		void clear()
+		{
+			for (size_t i = 0; i < m_Capacity; ++i)
+			{
+				if (m_Distances[i] != 0)
+				{
+					m_Slots[i].~value_type();
+					m_Distances[i] = 0;
+				}
+			}
+			m_Size = 0;
+		}
+
+		void reserve(size_t count)
+		{
+			size_t capacity = MinCapacity;
+			while (capacity * MaxLoadNumerator / MaxLoadDenominator < count)
+			{
+				capacity *= 2;
+			}
+			if (capacity > m_Capacity)
+			{
+				Rehash(capacity);
+			}
+		}
+
+		ProbeStats GetProbeStats() const
+		{
+			ProbeStats stats;
+			stats.size = m_Size;
+			stats.capacity = m_Capacity;
+			size_t total = 0;
+			for (size_t i = 0; i < m_Capacity; ++i)
+			{
+				if (m_Distances[i] != 0)
+				{
+					total += m_Distances[i];
+					stats.maxProbeLength = std::max<size_t>(stats.maxProbeLength, m_Distances[i]);
+				}
+			}
+			stats.averageProbeLength = m_Size ? static_cast<double>(total) / m_Size : 0.0;
+			return stats;
+		}
+
+	private:
+		static constexpr size_t NotFound = ~size_t(0);
+		static constexpr size_t MinCapacity = 8;
+		static constexpr size_t MaxLoadNumerator = 7;
+		static constexpr size_t MaxLoadDenominator = 8;
+
+		// Fibonacci hashing spreads the bits of weak hashes (such as identity hashes of integers)
+		// over the whole table before masking.
+		size_t Home(const TKey& key) const
+		{
+			uint64_t hash = static_cast<uint64_t>(THash()(key)) * 0x9E3779B97F4A7C15ull;
+			return static_cast<size_t>(hash >> m_Shift);
+		}
+
+		size_t FindIndex(const TKey& key) const
+		{
+			if (m_Size == 0) return NotFound;
+			size_t index = Home(key);
+			for (uint32_t distance = 1; distance <= m_Distances[index]; ++distance)
+			{
+				if (m_Distances[index] == distance && m_Slots[index].first == key)
+				{
+					return index;
+				}
+				index = (index + 1) & m_Mask;
+			}
+			return NotFound;
+		}
+
+		void Insert(value_type&& value)
+		{
+			if ((m_Size + 1) * MaxLoadDenominator > m_Capacity * MaxLoadNumerator)
+			{
+				Rehash(m_Capacity ? m_Capacity * 2 : MinCapacity);
+			}
+
+			size_t index = Home(value.first);
+			uint32_t distance = 1;
+			while (m_Distances[index] != 0)
+			{
+				// Robin hood, the element closer to its home gives up the slot.
+				if (m_Distances[index] < distance)
+				{
+					std::swap(value, m_Slots[index]);
+					std::swap(distance, m_Distances[index]);
+				}
+				index = (index + 1) & m_Mask;
+				++distance;
+			}
+			new (&m_Slots[index]) value_type(std::move(value));
+			m_Distances[index] = distance;
+			++m_Size;
+		}
+
+		void Rehash(size_t capacity)
+		{
+			FlatMap old;
+			Swap(old);
+			m_Slots = std::allocator<value_type>().allocate(capacity);
+			m_Distances = new uint32_t[capacity]();
+			m_Capacity = capacity;
+			m_Mask = capacity - 1;
+			m_Shift = 64;
+			for (size_t i = capacity; i > 1; i >>= 1)
+			{
+				--m_Shift;
+			}
+			for (size_t i = 0; i < old.m_Capacity; ++i)
+			{
+				if (old.m_Distances[i] != 0)
+				{
+					Insert(std::move(old.m_Slots[i]));
+				}
+			}
+		}
+
+		void Release()
+		{
+			if (m_Slots == nullptr) return;
+			clear();
+			std::allocator<value_type>().deallocate(m_Slots, m_Capacity);
+			delete[] m_Distances;
+			m_Slots = nullptr;
+			m_Distances = nullptr;
+		}
+
+		void Swap(FlatMap& other) noexcept
+		{
+			std::swap(m_Slots, other.m_Slots);
+			std::swap(m_Distances, other.m_Distances);
+			std::swap(m_Capacity, other.m_Capacity);
+			std::swap(m_Size, other.m_Size);
+			std::swap(m_Mask, other.m_Mask);
+			std::swap(m_Shift, other.m_Shift);
+		}
+
+		value_type* m_Slots = nullptr;
+		// Probe length of each slot plus one, 0 marks an empty slot.
+		uint32_t* m_Distances = nullptr;
+		size_t m_Capacity = 0;
+		size_t m_Size = 0;
+		size_t m_Mask = 0;
+		uint32_t m_Shift = 64;
+	};
+}
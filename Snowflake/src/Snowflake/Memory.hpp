@@ -0,0 +1,243 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <vector>
+#include "Snowflake.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace Snowflake
+{
+	// Paged block allocator meant to back the component pools of a registry, e.g.
+	//   PageResource pages;
+	//   Registry registry(&pages);
+	// Memory is mapped from the OS in 2 MiB chunks that are split into equally sized blocks,
+	// chunks are backed by huge pages when the OS grants them (Linux hugetlbfs pages or
+	// transparent huge pages, Windows large pages which need SeLockMemoryPrivilege).
+	// Freed blocks are reused, chunks only go back to the OS through Trim or the destructor,
+	// so the mapped size stays bounded by the peak usage. Not thread safe, like the registry.
+	class PageResource : public std::pmr::memory_resource
+	{
+	public:
+		static constexpr size_t ChunkSize = 2 * 1024 * 1024;
+
+		explicit PageResource(size_t blockSize = PoolPageSize, bool useHugePages = true)
+			: m_HugePages(useHugePages)
+		{
+			m_BlockSize = (std::max<size_t>(blockSize, 1) + BlockAlignment - 1) / BlockAlignment * BlockAlignment;
+			m_BlocksPerChunk = std::max<size_t>(ChunkSize / m_BlockSize, 1);
+		}
+
+		~PageResource()
+		{
+			for (auto& chunk : m_Chunks)
+			{
+				Unmap(chunk.data, chunk.size);
+			}
+		}
+
+		PageResource(const PageResource&) = delete;
+		PageResource& operator=(const PageResource&) = delete;
+
+		// Returns the chunks whose blocks are all free to the OS.
+		void Trim()
+		{
+			auto isEmpty = [&](const Chunk& chunk) { return !chunk.large && chunk.freeBlocks == m_BlocksPerChunk; };
+			m_FreeBlocks.erase(std::remove_if(m_FreeBlocks.begin(), m_FreeBlocks.end(), [&](uint8_t* block)
+				{
+					return isEmpty(*FindChunk(block));
+				}), m_FreeBlocks.end());
+			for (auto& chunk : m_Chunks)
+			{
+				if (isEmpty(chunk))
+				{
+					Unmap(chunk.data, chunk.size);
+					m_MappedBytes -= chunk.size;
+					m_HugePageBytes -= chunk.hugePages ? chunk.size : 0;
+				}
+			}
+			m_Chunks.erase(std::remove_if(m_Chunks.begin(), m_Chunks.end(), isEmpty), m_Chunks.end());
+		}
+
+		// Bytes mapped from the OS.
+		size_t GetMappedBytes() const
+		{
+			return m_MappedBytes;
+		}
+
+		// Bytes handed out, rounded up to whole blocks.
+		size_t GetAllocatedBytes() const
+		{
+			return m_AllocatedBytes;
+		}
+
+		size_t GetHugePageBytes() const
+		{
+			return m_HugePageBytes;
+		}
+
+	protected:
+		void* do_allocate(size_t bytes, size_t alignment) override
+		{
+			if (bytes > m_BlockSize || alignment > BlockAlignment)
+			{
+				// Larger than a block, gets a mapping of its own.
+				if (alignment > OsPageSize)
+				{
+					throw std::bad_alloc();
+				}
+				bool hugePages = false;
+				size_t size = (bytes + OsPageSize - 1) / OsPageSize * OsPageSize;
+				uint8_t* data = MapChunk(size, hugePages, true);
+				m_AllocatedBytes += size;
+				return data;
+			}
+			if (m_FreeBlocks.empty())
+			{
+				bool hugePages = m_HugePages;
+				uint8_t* data = MapChunk(m_BlocksPerChunk * m_BlockSize, hugePages, false);
+				m_HugePages = hugePages;
+				// Reversed so blocks are handed out in address order.
+				for (size_t i = m_BlocksPerChunk; i > 0; --i)
+				{
+					m_FreeBlocks.push_back(data + (i - 1) * m_BlockSize);
+				}
+			}
+			uint8_t* block = m_FreeBlocks.back();
+			m_FreeBlocks.pop_back();
+			--FindChunk(block)->freeBlocks;
+			m_AllocatedBytes += m_BlockSize;
+			return block;
+		}
+
+		void do_deallocate(void* pointer, size_t, size_t) override
+		{
+			uint8_t* block = static_cast<uint8_t*>(pointer);
+			auto chunk = FindChunk(block);
+			if (chunk->large)
+			{
+				Unmap(chunk->data, chunk->size);
+				m_AllocatedBytes -= chunk->size;
+				m_MappedBytes -= chunk->size;
+				m_HugePageBytes -= chunk->hugePages ? chunk->size : 0;
+				m_Chunks.erase(chunk);
+				return;
+			}
+			++chunk->freeBlocks;
+			m_FreeBlocks.push_back(block);
+			m_AllocatedBytes -= m_BlockSize;
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+		{
+			return this == &other;
+		}
+
+	private:
+		static constexpr size_t BlockAlignment = 64;
+		static constexpr size_t OsPageSize = 4096;
+
+		struct Chunk
+		{
+			uint8_t* data = nullptr;
+			size_t size = 0;
+			size_t freeBlocks = 0;
+			bool large = false;
+			bool hugePages = false;
+		};
+
+		// Chunks are kept sorted by address.
+		std::vector<Chunk>::iterator FindChunk(uint8_t* pointer)
+		{
+			auto it = std::upper_bound(m_Chunks.begin(), m_Chunks.end(), pointer, [](uint8_t* value, const Chunk& chunk) { return value < chunk.data; });
+			return it - 1;
+		}
+
+		uint8_t* MapChunk(size_t size, bool& hugePages, bool large)
+		{
+			uint8_t* data = Map(size, hugePages);
+			if (data == nullptr)
+			{
+				throw std::bad_alloc();
+			}
+			Chunk chunk;
+			chunk.data = data;
+			chunk.size = size;
+			chunk.freeBlocks = large ? 0 : m_BlocksPerChunk;
+			chunk.large = large;
+			chunk.hugePages = hugePages;
+			auto it = std::upper_bound(m_Chunks.begin(), m_Chunks.end(), data, [](uint8_t* value, const Chunk& other) { return value < other.data; });
+			m_Chunks.insert(it, chunk);
+			m_MappedBytes += size;
+			m_HugePageBytes += hugePages ? size : 0;
+			return data;
+		}
+
+		// Clears hugePages when they could not be used.
+		static uint8_t* Map(size_t size, bool& hugePages)
+		{
+			hugePages = hugePages && size % ChunkSize == 0;
+#ifdef _WIN32
+			if (hugePages)
+			{
+				size_t largePageSize = GetLargePageMinimum();
+				if (largePageSize != 0 && size % largePageSize == 0)
+				{
+					void* data = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+					if (data != nullptr) return static_cast<uint8_t*>(data);
+				}
+				hugePages = false;
+			}
+			return static_cast<uint8_t*>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+			if (hugePages)
+			{
+#ifdef MAP_HUGETLB
+				void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+				if (data != MAP_FAILED) return static_cast<uint8_t*>(data);
+#endif
+				hugePages = false;
+			}
+			void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (data == MAP_FAILED) return nullptr;
+#ifdef MADV_HUGEPAGE
+			// Transparent huge pages are a hint, chunks stay usable without them.
+			if (size % ChunkSize == 0)
+			{
+				madvise(data, size, MADV_HUGEPAGE);
+			}
+#endif
+			return static_cast<uint8_t*>(data);
+#endif
+		}
+
+		static void Unmap(uint8_t* data, size_t size)
+		{
+#ifdef _WIN32
+			(void)size;
+			VirtualFree(data, 0, MEM_RELEASE);
+#else
+			munmap(data, size);
+#endif
+		}
+
+		size_t m_BlockSize;
+		size_t m_BlocksPerChunk;
+		bool m_HugePages;
+		size_t m_MappedBytes = 0;
+		size_t m_AllocatedBytes = 0;
+		size_t m_HugePageBytes = 0;
+		std::vector<Chunk> m_Chunks;
+		std::vector<uint8_t*> m_FreeBlocks;
+	};
+}
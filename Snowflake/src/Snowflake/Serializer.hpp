@@ -2,10 +2,13 @@
 #include <filesystem>
 #include <fstream>
 #define USE_SERIALIZER
+#include <iterator>
 #include <numeric>
 #include <random>
+#include <sstream>
 
 #include "Snowflake.hpp"
+#include "Compression.hpp"
 namespace Snowflake
 {
 
@@ -14,8 +17,24 @@ namespace Snowflake
 	public:
 		RegistrySerializer(Registry& registry);
 		bool Serialize(const std::filesystem::path& filePath);
+		// Writes the same data as Serialize but block compressed, Deserialize detects either format.
+		bool Serialize(const std::filesystem::path& filePath, const CompressionSettings& settings);
 		bool Deserialize(const std::filesystem::path& filePath);
 	private:
+		struct MemoryBuffer : std::streambuf
+		{
+			MemoryBuffer(uint8_t* data, size_t size)
+			{
+				setg(reinterpret_cast<char*>(data), reinterpret_cast<char*>(data), reinterpret_cast<char*>(data + size));
+			}
+		};
+
+		static constexpr size_t MaxResourceSize = 64 * 1024 * 1024;
+
+		void Write(std::ostream& stream);
+		bool Read(std::istream& stream);
+		uint32_t FindRecordSize();
+		static SnowID ReadID(const uint8_t* data);
 		Registry& m_Registry;
 	};
 
@@ -30,13 +49,81 @@ namespace Snowflake
 		{
 			return false;
 		}
+		Write(writeFile);
+		writeFile.close();
+		if (!writeFile.good())
+		{
+			return false;
+		}
+		return true;
+	}
+
+	inline bool RegistrySerializer::Serialize(const std::filesystem::path& filePath, const CompressionSettings& settings)
+	{
+		std::ofstream writeFile(filePath.string(), std::ios::out | std::ios::binary);
+		if (!writeFile)
+		{
+			return false;
+		}
+		std::ostringstream rawStream(std::ios::out | std::ios::binary);
+		Write(rawStream);
+		std::string raw = rawStream.str();
+
+		CompressionSettings blockSettings = settings;
+		if (blockSettings.filter != CompressionFilter::None && blockSettings.stride == 0)
+		{
+			blockSettings.stride = FindRecordSize();
+		}
+		auto compressed = BlockCompression::Compress(reinterpret_cast<const uint8_t*>(raw.data()), raw.size(), blockSettings);
+		writeFile.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+		writeFile.close();
+		if (!writeFile.good())
+		{
+			return false;
+		}
+		return true;
+	}
+
+	inline bool RegistrySerializer::Deserialize(const std::filesystem::path& filePath)
+	{
+		std::ifstream readFile(filePath.string(), std::ios::in | std::ios::binary);
+		if (!readFile)
+		{
+			return false;
+		}
+		uint64_t magic = 0;
+		readFile.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+		if (!readFile.good() || magic != BlockCompression::Magic)
+		{
+			readFile.clear();
+			readFile.seekg(0);
+			bool result = Read(readFile);
+			readFile.close();
+			return result;
+		}
+
+		readFile.seekg(0);
+		std::vector<uint8_t> compressed((std::istreambuf_iterator<char>(readFile)), std::istreambuf_iterator<char>());
+		readFile.close();
+		std::vector<uint8_t> raw;
+		if (!BlockCompression::Decompress(compressed.data(), compressed.size(), raw))
+		{
+			return false;
+		}
+		MemoryBuffer buffer(raw.data(), raw.size());
+		std::istream rawStream(&buffer);
+		return Read(rawStream);
+	}
+
+	inline void RegistrySerializer::Write(std::ostream& stream)
+	{
 		uint32_t entityByteLength = 0;
 		std::vector<SnowID> currentEntityComponents;
 		auto data = m_Registry.m_Entities.size();
-		writeFile.write(reinterpret_cast<char*>(&data), sizeof(size_t));
+		stream.write(reinterpret_cast<char*>(&data), sizeof(size_t));
 		m_Registry.ForEach([&](auto entity)
 			{
-				for (auto it : m_Registry.m_ComponentPools)
+				for (auto& it : m_Registry.m_ComponentPools)
 				{
 					if (it.second.IsEntityRegistered(entity))
 					{
@@ -44,58 +131,132 @@ namespace Snowflake
 						entityByteLength += componentSizes[it.first];
 					}
 				}
-				writeFile.write(reinterpret_cast<char*>(&entityByteLength), sizeof(uint32_t));
+				stream.write(reinterpret_cast<char*>(&entityByteLength), sizeof(uint32_t));
 				for (auto it : currentEntityComponents)
 				{
-					writeFile.write(reinterpret_cast<char*>(&componentSizes[it]), sizeof(size_t));
+					stream.write(reinterpret_cast<char*>(&componentSizes[it]), sizeof(size_t));
 					auto pCompData = m_Registry.m_ComponentPools[it].GetComponentData(entity);
-					
-					writeFile.write(reinterpret_cast<char*>(&pCompData[0]), componentSizes[it]);
+
+					stream.write(reinterpret_cast<char*>(&pCompData[0]), componentSizes[it]);
 				}
 				entityByteLength = 0;
 				currentEntityComponents.clear();
 			});
-		writeFile.close();
-		if (!writeFile.good())
+
+		// Resources follow the entities, length prefixed like components. Resources loaded
+		// earlier whose type was never requested are written back unchanged.
+		size_t resourceCount = m_Registry.m_PendingResources.size();
+		for (auto& resource : m_Registry.m_Resources)
 		{
-			return false;
+			resourceCount += resource && !resource->id.IsNull() ? 1 : 0;
+		}
+		stream.write(reinterpret_cast<char*>(&resourceCount), sizeof(size_t));
+		for (auto& resource : m_Registry.m_Resources)
+		{
+			if (!resource || resource->id.IsNull()) continue;
+			size_t size = resource->Size();
+			stream.write(reinterpret_cast<char*>(&size), sizeof(size_t));
+			stream.write(reinterpret_cast<char*>(resource->Data()), size);
+		}
+		for (auto& it : m_Registry.m_PendingResources)
+		{
+			size_t size = it.second.size();
+			stream.write(reinterpret_cast<char*>(&size), sizeof(size_t));
+			stream.write(reinterpret_cast<char*>(it.second.data()), size);
 		}
-		return true;
 	}
 
-	inline bool RegistrySerializer::Deserialize(const std::filesystem::path& filePath)
+	inline bool RegistrySerializer::Read(std::istream& stream)
 	{
-		std::ifstream readFile(filePath.string(), std::ios::out | std::ios::binary);
-		if (!readFile)
-		{
-			return false;
-		}
 		size_t entityCount = 0;
-		readFile.read(reinterpret_cast<char*>(&entityCount), sizeof(size_t));
-		for (size_t i = 0; i < entityCount; ++i)
+		stream.read(reinterpret_cast<char*>(&entityCount), sizeof(size_t));
+		for (size_t i = 0; i < entityCount && stream.good(); ++i)
 		{
 			uint32_t entityByteLength = 0;
-			readFile.read(reinterpret_cast<char*>(&entityByteLength), sizeof(uint32_t));
+			stream.read(reinterpret_cast<char*>(&entityByteLength), sizeof(uint32_t));
 			auto entity = m_Registry.CreateEntity();
-			while (entityByteLength > 0)
+			while (entityByteLength > 0 && stream.good())
 			{
 				size_t componentLength = 0;
-				readFile.read(reinterpret_cast<char*>(&componentLength), sizeof(size_t));
+				stream.read(reinterpret_cast<char*>(&componentLength), sizeof(size_t));
+				if (componentLength < sizeof(SnowID) || componentLength > entityByteLength)
+				{
+					return false;
+				}
 				std::vector<uint8_t> componentData;
 				componentData.resize(componentLength);
-				readFile.read(reinterpret_cast<char*>(&componentData[0]), componentLength);
-				SnowID readID;
-				memcpy(&readID, componentData.data(), sizeof(SnowID));
+				stream.read(reinterpret_cast<char*>(&componentData[0]), componentLength);
+				SnowID readID = ReadID(componentData.data());
 				m_Registry.AddComponentFromData(componentData, readID, entity);
-				entityByteLength -= componentLength;
+				entityByteLength -= static_cast<uint32_t>(componentLength);
 
 			}
 		}
-		readFile.close();
-		if (!readFile.good())
+		if (!stream.good())
 		{
 			return false;
 		}
-		return true;
+
+		// Files written before resources were serialized end here.
+		if (stream.peek() == std::char_traits<char>::eof())
+		{
+			return true;
+		}
+		size_t resourceCount = 0;
+		stream.read(reinterpret_cast<char*>(&resourceCount), sizeof(size_t));
+		for (size_t i = 0; i < resourceCount && stream.good(); ++i)
+		{
+			size_t resourceLength = 0;
+			stream.read(reinterpret_cast<char*>(&resourceLength), sizeof(size_t));
+			if (resourceLength < sizeof(SnowID) || resourceLength > MaxResourceSize)
+			{
+				return false;
+			}
+			ByteSet resourceData(resourceLength);
+			stream.read(reinterpret_cast<char*>(resourceData.data()), resourceLength);
+			SnowID readID = ReadID(resourceData.data());
+			m_Registry.SetResourceFromData(resourceData, readID);
+		}
+		return stream.good();
+	}
+
+	// Records start with the SnowID of their type, stored as its high then low half.
+	inline SnowID RegistrySerializer::ReadID(const uint8_t* data)
+	{
+		uint64_t hiPart = 0;
+		uint64_t loPart = 0;
+		memcpy(&hiPart, data, sizeof(hiPart));
+		memcpy(&loPart, data + sizeof(hiPart), sizeof(loPart));
+		return SnowID(hiPart, loPart);
+	}
+
+	// Byte length of the most common entity record, the distance between two values of a component column.
+	inline uint32_t RegistrySerializer::FindRecordSize()
+	{
+		FlatMap<uint32_t, size_t> recordCounts;
+		m_Registry.ForEach([&](auto entity)
+			{
+				uint32_t recordSize = sizeof(uint32_t);
+				for (auto& it : m_Registry.m_ComponentPools)
+				{
+					if (it.second.IsEntityRegistered(entity))
+					{
+						recordSize += static_cast<uint32_t>(sizeof(size_t) + componentSizes[it.first]);
+					}
+				}
+				++recordCounts[recordSize];
+			});
+
+		uint32_t recordSize = 1;
+		size_t maxCount = 0;
+		for (auto& it : recordCounts)
+		{
+			if (it.second > maxCount)
+			{
+				maxCount = it.second;
+				recordSize = it.first;
+			}
+		}
+		return recordSize;
 	}
 }
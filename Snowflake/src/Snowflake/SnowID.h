@@ -1,7 +1,8 @@
 #pragma once
 
 #include <cstdint>
-#include <xhash>
+#include <cstddef>
+#include <functional>
 
 // From ChunkTreasure1s Wire ECS system
 // https://github.com/ChunkTreasure1/Wire
@@ -36,6 +37,22 @@ struct SnowID
 		return SnowID(0, 0);
 	}
 
+	// Murmur3 64 bit finalizer, every input bit affects every output bit.
+	constexpr static uint64_t Mix(uint64_t x)
+	{
+		x ^= x >> 33;
+		x *= 0xFF51AFD7ED558CCDull;
+		x ^= x >> 33;
+		x *= 0xC4CEB9FE1A85EC53ull;
+		x ^= x >> 33;
+		return x;
+	}
+
+	constexpr uint64_t Hash() const
+	{
+		return Mix(hiPart ^ Mix(loPart + 0x9E3779B97F4A7C15ull));
+	}
+
 	constexpr bool IsNull() const { return hiPart == 0 && loPart == 0; }
 	constexpr bool operator==(const SnowID& rhs) const { return hiPart == rhs.hiPart && loPart == rhs.loPart; }
 	constexpr bool operator!=(const SnowID& rhs) const { return hiPart != rhs.hiPart || loPart != rhs.loPart; }
@@ -124,8 +141,7 @@ namespace std
 	{
 		size_t operator()(const SnowID& guid) const
 		{
-			std::hash<uint64_t> hasher;
-			return hasher(guid.loPart) ^ hasher(guid.hiPart);
+			return static_cast<size_t>(guid.Hash());
 		}
 	};
 }
\ No newline at end of file
@@ -3,39 +3,86 @@
 #include <cstdint>
 #include <vector>
 #include <array>
+#include <atomic>
 #include <bitset>
 #include <cassert>
-#include <unordered_map>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
 #include "SnowID.h"
+#include "FlatMap.hpp"
+#include "Trace.hpp"
 #define COMPONENT(comp) struct comp \
 						
 #define REGISTER_COMPONENT(GUID) const SnowID hashID = GUID
 
 namespace Snowflake
 {
-	inline std::unordered_map<SnowID, size_t> componentSizes;
+	inline FlatMap<SnowID, size_t> componentSizes;
 	constexpr uint32_t InvalidEntity = ~0;
 
 	using Entity = uint32_t;
 	using ByteSet = std::vector<uint8_t>;
 
+	// Bytes of every pool page, a page holds as many component slots as fit.
+	constexpr size_t PoolPageSize = 16 * 1024;
+
+	// Component storage only, the bookkeeping maps of the registry are not included.
+	struct MemoryUsage
+	{
+		// Bytes of the pool pages taken from the memory resource.
+		size_t allocatedBytes = 0;
+		// Bytes of live components.
+		size_t usedBytes = 0;
+		size_t componentCount = 0;
+	};
+
+	// Components are kept in fixed size slots inside pages allocated from a memory resource.
+	// Freed slots are reused before a new page is allocated, pages are only given back by ShrinkToFit.
 	class ComponentPool
 	{
 		friend class Registry;
 	public:
 		ComponentPool() = default;
-		ComponentPool(SnowID id) : m_Id(id)
+		// alignment has to be a power of two no larger than alignof(std::max_align_t).
+		ComponentPool(SnowID id, size_t componentSize, size_t alignment, std::pmr::memory_resource* resource)
+			: m_Id(id), m_ComponentSize(componentSize), m_Resource(resource)
+		{
+			assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && alignment <= alignof(std::max_align_t));
+			m_Stride = (std::max<size_t>(componentSize, 1) + alignment - 1) / alignment * alignment;
+			m_SlotsPerPage = static_cast<uint32_t>(std::max<size_t>(PoolPageSize / m_Stride, 1));
+		}
+
+		~ComponentPool()
 		{
+			ReleasePages(0);
 		}
+
+		ComponentPool(const ComponentPool&) = delete;
+		ComponentPool& operator=(const ComponentPool&) = delete;
+
+		ComponentPool(ComponentPool&& other) noexcept
+		{
+			Swap(other);
+		}
+
+		ComponentPool& operator=(ComponentPool&& other) noexcept
+		{
+			Swap(other);
+			return *this;
+		}
+
 		template<class T>
 		void RegisterEntity(Entity entity)
 		{
 			if (m_ComponentMap.find(entity) == m_ComponentMap.end())
 			{
-				m_ComponentMap[entity] = ByteSet();
-				m_ComponentMap[entity].resize(sizeof(T));
-				memcpy(m_ComponentMap[entity].data(), &T(), sizeof(T));
+				T component;
+				memcpy(AllocateSlot(entity), &component, sizeof(T));
 			}
 		}
 
@@ -43,18 +90,24 @@ namespace Snowflake
 		{
 			if (m_ComponentMap.find(entity) == m_ComponentMap.end())
 			{
-				m_ComponentMap[entity] = ByteSet();
-				m_ComponentMap[entity].resize(byteSet.size());
-				memcpy(m_ComponentMap[entity].data(), byteSet.data(), byteSet.size());
+				uint8_t* data = AllocateSlot(entity);
+				size_t size = std::min(byteSet.size(), m_ComponentSize);
+				memcpy(data, byteSet.data(), size);
+				memset(data + size, 0, m_ComponentSize - size);
 			}
 		}
 
 		void DeRegisterEntity(Entity entity)
 		{
-			m_ComponentMap.erase(entity);
+			auto it = m_ComponentMap.find(entity);
+			if (it != m_ComponentMap.end())
+			{
+				m_FreeSlots.push_back(it->second.index);
+				m_ComponentMap.erase(entity);
+			}
 		}
 
-		bool IsEntityRegistered(Entity entity)
+		bool IsEntityRegistered(Entity entity) const
 		{
 			return m_ComponentMap.find(entity) != m_ComponentMap.end();
 		}
@@ -62,19 +115,468 @@ namespace Snowflake
 		template<typename T>
 		T& GetComponent(Entity entity)
 		{
-			return *(T*)(m_ComponentMap[entity].data());
+			auto it = m_ComponentMap.find(entity);
+			assert(it != m_ComponentMap.end());
+			return *reinterpret_cast<T*>(it->second.data);
 		}
 
 		std::vector<uint8_t> GetComponentData(Entity entity)
 		{
-			std::vector<uint8_t> data;
-			data.resize(m_ComponentMap[entity].size());
-			memcpy(data.data(), m_ComponentMap[entity].data(), m_ComponentMap[entity].size());
-			return data;
+			auto it = m_ComponentMap.find(entity);
+			assert(it != m_ComponentMap.end());
+			return std::vector<uint8_t>(it->second.data, it->second.data + m_ComponentSize);
+		}
+
+		MemoryUsage GetMemoryUsage() const
+		{
+			MemoryUsage usage;
+			usage.allocatedBytes = m_Pages.size() * PageBytes();
+			usage.usedBytes = m_ComponentMap.size() * m_ComponentSize;
+			usage.componentCount = m_ComponentMap.size();
+			return usage;
+		}
+
+		// Moves the components into the lowest slots and releases the pages left empty.
+		// Invalidates pointers and references to the components of this pool.
+		void ShrinkToFit()
+		{
+			const uint32_t count = static_cast<uint32_t>(m_ComponentMap.size());
+			m_FreeSlots.erase(std::remove_if(m_FreeSlots.begin(), m_FreeSlots.end(), [&](uint32_t index) { return index >= count; }), m_FreeSlots.end());
+			for (auto& it : m_ComponentMap)
+			{
+				if (it.second.index < count) continue;
+				// Every slot above count that is in use has a free counterpart below it.
+				uint32_t index = m_FreeSlots.back();
+				m_FreeSlots.pop_back();
+				uint8_t* data = SlotData(index);
+				memcpy(data, it.second.data, m_ComponentSize);
+				it.second = Slot{ data, index };
+			}
+			m_FreeSlots.clear();
+			m_FreeSlots.shrink_to_fit();
+			m_SlotCount = count;
+			ReleasePages((count + m_SlotsPerPage - 1) / m_SlotsPerPage);
 		}
 	private:
+		struct Slot
+		{
+			uint8_t* data = nullptr;
+			uint32_t index = 0;
+		};
+
+		// The tail after the last slot is still requested, so the page size is what gets reserved.
+		size_t PageBytes() const
+		{
+			return std::max(PoolPageSize, m_Stride * m_SlotsPerPage);
+		}
+
+		uint8_t* SlotData(uint32_t index) const
+		{
+			return m_Pages[index / m_SlotsPerPage] + static_cast<size_t>(index % m_SlotsPerPage) * m_Stride;
+		}
+
+		uint8_t* AllocateSlot(Entity entity)
+		{
+			uint32_t index = m_SlotCount;
+			if (!m_FreeSlots.empty())
+			{
+				index = m_FreeSlots.back();
+				m_FreeSlots.pop_back();
+			}
+			else
+			{
+				if (index / m_SlotsPerPage == m_Pages.size())
+				{
+					m_Pages.push_back(static_cast<uint8_t*>(m_Resource->allocate(PageBytes(), alignof(std::max_align_t))));
+				}
+				++m_SlotCount;
+			}
+			uint8_t* data = SlotData(index);
+			m_ComponentMap[entity] = Slot{ data, index };
+			return data;
+		}
+
+		void ReleasePages(size_t keep)
+		{
+			while (m_Pages.size() > keep)
+			{
+				m_Resource->deallocate(m_Pages.back(), PageBytes(), alignof(std::max_align_t));
+				m_Pages.pop_back();
+			}
+		}
+
+		void Swap(ComponentPool& other) noexcept
+		{
+			std::swap(m_Id, other.m_Id);
+			std::swap(m_ComponentSize, other.m_ComponentSize);
+			std::swap(m_Stride, other.m_Stride);
+			std::swap(m_SlotsPerPage, other.m_SlotsPerPage);
+			std::swap(m_SlotCount, other.m_SlotCount);
+			std::swap(m_Resource, other.m_Resource);
+			std::swap(m_Pages, other.m_Pages);
+			std::swap(m_FreeSlots, other.m_FreeSlots);
+			std::swap(m_ComponentMap, other.m_ComponentMap);
+		}
+
 		SnowID m_Id;
-		std::unordered_map<Entity, ByteSet> m_ComponentMap;
+		size_t m_ComponentSize = 0;
+		size_t m_Stride = 0;
+		uint32_t m_SlotsPerPage = 1;
+		// Slots handed out so far, every slot below is either in use or in m_FreeSlots.
+		uint32_t m_SlotCount = 0;
+		std::pmr::memory_resource* m_Resource = nullptr;
+		std::vector<uint8_t*> m_Pages;
+		std::vector<uint32_t> m_FreeSlots;
+		FlatMap<Entity, Slot> m_ComponentMap;
+	};
+
+	constexpr uint32_t InvalidIndex = ~0;
+
+	struct HierarchyNode
+	{
+		Entity entity = InvalidEntity;
+		Entity parent = InvalidEntity;
+		Entity firstChild = InvalidEntity;
+		Entity nextSibling = InvalidEntity;
+		Entity prevSibling = InvalidEntity;
+		// Updated by Hierarchy::Sort.
+		uint32_t parentIndex = InvalidIndex;
+		uint32_t depth = 0;
+	};
+
+	// Parent/child relations stored in one contiguous array sorted by depth.
+	// A parent is always stored before its children, so the nodes can be swept
+	// front to back in a single pass (e.g. to propagate world transforms).
+	// Depths are kept up to date by every change, which costs the size of the moved subtree.
+	// Changes that break the order only mark the array unsorted, Sort restores it with a
+	// counting sort over depth, a few sequential passes instead of following child links.
+	class Hierarchy
+	{
+		friend class Registry;
+	public:
+		bool Contains(Entity entity) const
+		{
+			return entity < m_Sparse.size() && m_Sparse[entity] != InvalidIndex;
+		}
+
+		const HierarchyNode* GetNode(Entity entity) const
+		{
+			return Contains(entity) ? &m_Nodes[m_Sparse[entity]] : nullptr;
+		}
+
+		// Depth sorted only after Sort, see IsSorted.
+		const std::vector<HierarchyNode>& GetNodes() const
+		{
+			return m_Nodes;
+		}
+
+		bool IsSorted() const
+		{
+			return !m_Dirty;
+		}
+
+		// Incremented whenever Sort moves nodes, indices into GetNodes stay valid while it is unchanged.
+		uint64_t GetVersion() const
+		{
+			return m_Version;
+		}
+
+		void SetParent(Entity child, Entity parent)
+		{
+			if (child == parent)
+			{
+				throw std::invalid_argument("SetParent called with the entity as its own parent.");
+			}
+			if (parent != InvalidEntity && IsDescendant(parent, child))
+			{
+				throw std::invalid_argument("SetParent called with a descendant as parent.");
+			}
+			if (!Contains(child))
+			{
+				Insert(child);
+			}
+			if (parent != InvalidEntity && !Contains(parent))
+			{
+				Insert(parent);
+			}
+
+			Unlink(child);
+			uint32_t depth = 0;
+			if (parent != InvalidEntity)
+			{
+				auto& parentNode = m_Nodes[m_Sparse[parent]];
+				auto& childNode = m_Nodes[m_Sparse[child]];
+				childNode.nextSibling = parentNode.firstChild;
+				childNode.parent = parent;
+				childNode.parentIndex = m_Sparse[parent];
+				if (parentNode.firstChild != InvalidEntity)
+				{
+					m_Nodes[m_Sparse[parentNode.firstChild]].prevSibling = child;
+				}
+				parentNode.firstChild = child;
+				depth = parentNode.depth + 1;
+			}
+			// A new parent at the old depth is still stored in front of child, the order holds.
+			if (m_Nodes[m_Sparse[child]].depth != depth)
+			{
+				SetSubtreeDepth(child, depth);
+			}
+		}
+
+		// Removes a single node, its children become roots.
+		void Remove(Entity entity)
+		{
+			if (!Contains(entity)) return;
+			Entity child = m_Nodes[m_Sparse[entity]].firstChild;
+			while (child != InvalidEntity)
+			{
+				auto& node = m_Nodes[m_Sparse[child]];
+				child = node.nextSibling;
+				node.parent = InvalidEntity;
+				node.parentIndex = InvalidIndex;
+				node.nextSibling = InvalidEntity;
+				node.prevSibling = InvalidEntity;
+				SetSubtreeDepth(node.entity, 0);
+			}
+			Unlink(entity);
+			Erase(entity);
+		}
+
+		// Removes root and all of its descendants, the removed entities are appended to out.
+		void RemoveSubtree(Entity root, std::vector<Entity>& out)
+		{
+			if (!Contains(root)) return;
+			size_t begin = out.size();
+			CollectSubtree(root, out);
+			Unlink(root);
+			for (size_t i = begin; i < out.size(); ++i)
+			{
+				Erase(out[i]);
+			}
+		}
+
+		// Appends root followed by its descendants in breadth first order.
+		void CollectSubtree(Entity root, std::vector<Entity>& out) const
+		{
+			size_t begin = out.size();
+			out.push_back(root);
+			for (size_t i = begin; i < out.size(); ++i)
+			{
+				for (Entity child = m_Nodes[m_Sparse[out[i]]].firstChild; child != InvalidEntity; child = m_Nodes[m_Sparse[child]].nextSibling)
+				{
+					out.push_back(child);
+				}
+			}
+		}
+
+		bool IsDescendant(Entity entity, Entity ancestor) const
+		{
+			while (Contains(entity))
+			{
+				if (entity == ancestor) return true;
+				entity = m_Nodes[m_Sparse[entity]].parent;
+			}
+			return false;
+		}
+
+		// Restores the depth order and parentIndex, does nothing if nothing changed.
+		// Nodes of equal depth keep their relative order.
+		void Sort()
+		{
+			if (!m_Dirty) return;
+			m_BandStarts.assign(static_cast<size_t>(m_MaxDepth) + 2, 0);
+			for (auto& node : m_Nodes)
+			{
+				++m_BandStarts[node.depth + 1];
+			}
+			for (size_t i = 1; i < m_BandStarts.size(); ++i)
+			{
+				m_BandStarts[i] += m_BandStarts[i - 1];
+			}
+			m_SortBuffer.resize(m_Nodes.size());
+			m_SortSource.resize(m_Nodes.size());
+			for (size_t i = 0; i < m_Nodes.size(); ++i)
+			{
+				uint32_t index = m_BandStarts[m_Nodes[i].depth]++;
+				m_SortBuffer[index] = m_Nodes[i];
+				m_SortSource[index] = static_cast<uint32_t>(i);
+			}
+			std::swap(m_Nodes, m_SortBuffer);
+			for (size_t i = 0; i < m_Nodes.size(); ++i)
+			{
+				m_Sparse[m_Nodes[i].entity] = static_cast<uint32_t>(i);
+			}
+			for (auto& node : m_Nodes)
+			{
+				node.parentIndex = node.parent == InvalidEntity ? InvalidIndex : m_Sparse[node.parent];
+			}
+			m_MaxDepth = m_Nodes.empty() ? 0 : m_Nodes.back().depth;
+			m_SortSourceValid = !m_Resized;
+			m_Resized = false;
+			m_Dirty = false;
+			++m_Version;
+		}
+
+	private:
+		void Insert(Entity entity)
+		{
+			if (entity >= m_Sparse.size())
+			{
+				m_Sparse.resize(static_cast<size_t>(entity) + 1, InvalidIndex);
+			}
+			m_Sparse[entity] = static_cast<uint32_t>(m_Nodes.size());
+			HierarchyNode node;
+			node.entity = entity;
+			m_Nodes.push_back(node);
+			m_Dirty = true;
+			m_Resized = true;
+		}
+
+		// Swaps the node with the last one, the order is restored by the next Sort.
+		void Erase(Entity entity)
+		{
+			uint32_t index = m_Sparse[entity];
+			if (index != m_Nodes.size() - 1)
+			{
+				m_Nodes[index] = m_Nodes.back();
+				m_Sparse[m_Nodes[index].entity] = index;
+			}
+			m_Nodes.pop_back();
+			m_Sparse[entity] = InvalidIndex;
+			m_Dirty = true;
+			m_Resized = true;
+		}
+
+		void SetSubtreeDepth(Entity root, uint32_t depth)
+		{
+			m_Scratch.clear();
+			CollectSubtree(root, m_Scratch);
+			const int64_t delta = static_cast<int64_t>(depth) - static_cast<int64_t>(m_Nodes[m_Sparse[root]].depth);
+			for (auto entity : m_Scratch)
+			{
+				auto& node = m_Nodes[m_Sparse[entity]];
+				node.depth = static_cast<uint32_t>(node.depth + delta);
+				m_MaxDepth = std::max(m_MaxDepth, node.depth);
+			}
+			m_Dirty = true;
+		}
+
+		void Unlink(Entity entity)
+		{
+			auto& node = m_Nodes[m_Sparse[entity]];
+			if (node.parent != InvalidEntity)
+			{
+				if (node.prevSibling != InvalidEntity)
+				{
+					m_Nodes[m_Sparse[node.prevSibling]].nextSibling = node.nextSibling;
+				}
+				else
+				{
+					m_Nodes[m_Sparse[node.parent]].firstChild = node.nextSibling;
+				}
+				if (node.nextSibling != InvalidEntity)
+				{
+					m_Nodes[m_Sparse[node.nextSibling]].prevSibling = node.prevSibling;
+				}
+			}
+			node.parent = InvalidEntity;
+			node.parentIndex = InvalidIndex;
+			node.nextSibling = InvalidEntity;
+			node.prevSibling = InvalidEntity;
+		}
+
+		std::vector<HierarchyNode> m_Nodes;
+		std::vector<uint32_t> m_Sparse;
+		std::vector<Entity> m_Scratch;
+		std::vector<HierarchyNode> m_SortBuffer;
+		std::vector<uint32_t> m_BandStarts;
+		// Upper bound of the node depths, only used to size the counting sort.
+		uint32_t m_MaxDepth = 0;
+		// Index before the last Sort of every node. Only valid if no node was added or
+		// removed in between, so data kept per node index can follow the nodes.
+		std::vector<uint32_t> m_SortSource;
+		uint64_t m_Version = 0;
+		bool m_Dirty = false;
+		bool m_Resized = false;
+		bool m_SortSourceValid = false;
+	};
+
+	template<class T, class = void>
+	struct HasHashID : std::false_type {};
+
+	template<class T>
+	struct HasHashID<T, std::void_t<decltype(T().hashID)>> : std::true_type {};
+
+	// Hands out one slot per resource type on first use, later lookups are a plain vector index.
+	class ResourceIndex
+	{
+	public:
+		template<class T>
+		static uint32_t Get()
+		{
+			static const uint32_t index = Next();
+			return index;
+		}
+	private:
+		static uint32_t Next()
+		{
+			static std::atomic<uint32_t> counter{ 0 };
+			return counter++;
+		}
+	};
+
+	class ResourceBase
+	{
+	public:
+		explicit ResourceBase(const SnowID& id) : id(id)
+		{
+		}
+
+		virtual ~ResourceBase() = default;
+		virtual void* Data() = 0;
+		virtual size_t Size() const = 0;
+		// Null for resources that are not serialized.
+		SnowID id;
+	};
+
+	template<class T>
+	class Resource : public ResourceBase
+	{
+	public:
+		template<class ...TArgs>
+		Resource(TArgs&&... args) : ResourceBase(HashID()), value(Make(std::forward<TArgs>(args)...))
+		{
+		}
+
+		static SnowID HashID()
+		{
+			if constexpr (HasHashID<T>::value)
+			{
+				return T().hashID;
+			}
+			else
+			{
+				return SnowID::Null();
+			}
+		}
+
+		template<class ...TArgs>
+		static T Make(TArgs&&... args)
+		{
+			if constexpr (std::is_constructible_v<T, TArgs...>)
+			{
+				return T(std::forward<TArgs>(args)...);
+			}
+			else
+			{
+				return T{ std::forward<TArgs>(args)... };
+			}
+		}
+
+		void* Data() override { return &value; }
+		size_t Size() const override { return sizeof(T); }
+
+		T value;
 	};
 
 	class Registry
@@ -82,53 +584,87 @@ namespace Snowflake
 #ifdef USE_SERIALIZER
 		friend class RegistrySerializer;
 #endif
+		friend class TraceReplayer;
 	public:
+		// Component pages are allocated from resource, which has to outlive the registry.
+		explicit Registry(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : m_MemoryResource(resource)
+		{
+		}
+
+		// Destroyed entities are handed out again before new ids are used.
 		Entity CreateEntity()
 		{
-			Entity entity = m_Entities.size();
+			Entity entity = static_cast<Entity>(m_EntityIndices.size());
+			if (!m_FreeEntities.empty())
+			{
+				entity = m_FreeEntities.back();
+				m_FreeEntities.pop_back();
+			}
+			else
+			{
+				m_EntityIndices.push_back(InvalidIndex);
+			}
+			m_EntityIndices[entity] = static_cast<uint32_t>(m_Entities.size());
 			m_Entities.emplace_back(entity);
+			if (m_TraceRecorder) m_TraceRecorder->RecordEntity(TraceOp::CreateEntity, entity);
 			return entity;
 		}
 
-		// fix complexety to O(1)
 		bool DestroyEntity(Entity& entity)
 		{
-			if (entity == InvalidEntity) return false;
-			auto it = std::find(m_Entities.begin(), m_Entities.end(), entity);
-			if (it != m_Entities.end())
+			if (!ValidateEntity(entity)) return false;
+			ReleaseEntity(entity);
+			if (m_TraceRecorder) m_TraceRecorder->RecordEntity(TraceOp::DestroyEntity, entity);
+			m_Hierarchy.Remove(entity);
+			ReleaseComponents(entity);
+			entity = InvalidEntity;
+			return true;
+		}
+
+		// Destroys root and all of its descendants.
+		bool DestroyHierarchy(Entity& root)
+		{
+			if (!ValidateEntity(root)) return false;
+			if (!m_Hierarchy.Contains(root))
 			{
-				if (m_Entities.size() > 1)
-					std::swap(*it, m_Entities.back());
-				m_Entities.pop_back();
-				while (!m_Registry[entity].empty())
-				{
-					m_ComponentPools[m_Registry[entity].back()].DeRegisterEntity(entity);
-					m_Registry[entity].pop_back();
-				}
-				entity = InvalidEntity;
-				return true;
+				return DestroyEntity(root);
 			}
-			return false;
+			if (m_TraceRecorder) m_TraceRecorder->RecordEntity(TraceOp::DestroyHierarchy, root);
+			std::vector<Entity> subtree;
+			m_Hierarchy.RemoveSubtree(root, subtree);
+			for (auto entity : subtree)
+			{
+				ReleaseEntity(entity);
+				ReleaseComponents(entity);
+			}
+			root = InvalidEntity;
+			return true;
 		}
 
-		bool ValidateEntity(Entity entity)
+		bool ValidateEntity(Entity entity) const
 		{
-			auto it = std::find(m_Entities.begin(), m_Entities.end(), entity);
-			return it != m_Entities.end();
+			return entity < m_EntityIndices.size() && m_EntityIndices[entity] != InvalidIndex;
 		}
 
 		
 		template<class TComponent>
 		TComponent& AddComponent(Entity entity)
 		{
-			if (entity == InvalidEntity)
+			if (!ValidateEntity(entity))
 			{
 				throw std::invalid_argument("AddComponent called with invalid entity.");
 			}
 			auto& pool = MakeOrGetPool<TComponent>();
+			const size_t pageCount = pool.m_Pages.size();
 
 			pool.template RegisterEntity<TComponent>(entity);
 			m_Registry[entity].push_back(TComponent().hashID);
+			TouchHierarchySlots(entity);
+			if (m_TraceRecorder) m_TraceRecorder->RecordComponent(TraceOp::AddComponent, entity, TComponent().hashID, sizeof(TComponent));
+			if (pool.m_Pages.size() != pageCount)
+			{
+				m_BudgetPending = true;
+			}
 			return pool.template GetComponent<TComponent>(entity);
 		}
 
@@ -142,7 +678,7 @@ namespace Snowflake
 			auto& component = MakeOrGetPool<TComponent>();
 			if (HasComponent<TComponent>(entity))
 			{
-				return &component.GetComponent<TComponent>(entity);
+				return &component.template GetComponent<TComponent>(entity);
 			}
 			return nullptr;
 		}
@@ -155,7 +691,7 @@ namespace Snowflake
 				throw std::invalid_argument("GetComponent called with invalid entity.");
 			}
 			auto& component = MakeOrGetPool<TComponent>();
-			return component.GetComponent<TComponent>(entity);
+			return component.template GetComponent<TComponent>(entity);
 		}
 
 		template<class TComponent>
@@ -165,14 +701,9 @@ namespace Snowflake
 			{
 				throw std::invalid_argument("RemoveComponent called with invalid entity.");
 			}
-			auto& pool = MakeOrGetPool<TComponent>();
-			pool.DeRegisterEntity(entity);
-			auto& registry = m_Registry[entity];
-			auto it = std::find(registry.begin(), registry.end(), TComponent().hashID);
-			if (it != registry.end())
-			{
-				registry.erase(it);
-			}
+			MakeOrGetPool<TComponent>();
+			if (m_TraceRecorder) m_TraceRecorder->RecordComponent(TraceOp::RemoveComponent, entity, TComponent().hashID, sizeof(TComponent));
+			RemoveComponentFromId(TComponent().hashID, entity);
 		}
 
 		template<typename TComponent>
@@ -196,6 +727,269 @@ namespace Snowflake
 			return (HasComponent<TComponents>(entity) && ...);
 		}
 
+		void SetParent(Entity child, Entity parent)
+		{
+			if (!ValidateEntity(child) || (parent != InvalidEntity && !ValidateEntity(parent)))
+			{
+				throw std::invalid_argument("SetParent called with invalid entity.");
+			}
+			m_Hierarchy.SetParent(child, parent);
+			if (m_TraceRecorder) m_TraceRecorder->RecordSetParent(child, parent);
+		}
+
+		void RemoveParent(Entity child)
+		{
+			if (child == InvalidEntity)
+			{
+				throw std::invalid_argument("RemoveParent called with invalid entity.");
+			}
+			if (m_Hierarchy.Contains(child))
+			{
+				m_Hierarchy.SetParent(child, InvalidEntity);
+				if (m_TraceRecorder) m_TraceRecorder->RecordSetParent(child, InvalidEntity);
+			}
+		}
+
+		Entity GetParent(Entity entity) const
+		{
+			auto node = m_Hierarchy.GetNode(entity);
+			return node ? node->parent : InvalidEntity;
+		}
+
+		Entity GetFirstChild(Entity entity) const
+		{
+			auto node = m_Hierarchy.GetNode(entity);
+			return node ? node->firstChild : InvalidEntity;
+		}
+
+		Entity GetNextSibling(Entity entity) const
+		{
+			auto node = m_Hierarchy.GetNode(entity);
+			return node ? node->nextSibling : InvalidEntity;
+		}
+
+		// Sorted by depth, see Hierarchy::Sort.
+		const Hierarchy& GetHierarchy()
+		{
+			m_Hierarchy.Sort();
+			return m_Hierarchy;
+		}
+
+		// Visits every hierarchy node that has TComponent, parents before children.
+		// parent points to the parent's TComponent, or nullptr for roots and when the parent lacks it.
+		// The component of every node is cached per type, so an unchanged hierarchy is swept without lookups.
+		template<class TComponent, class TFunction>
+		void PropagateHierarchy(TFunction&& func)
+		{
+			m_Hierarchy.Sort();
+			auto poolIt = m_ComponentPools.find(TComponent().hashID);
+			if (poolIt == m_ComponentPools.end()) return;
+			auto& nodes = m_Hierarchy.m_Nodes;
+			auto& cache = m_HierarchySlots[TComponent().hashID];
+			if (cache.slotVersion == m_HierarchySlotVersion && cache.hierarchyVersion + 1 == m_Hierarchy.GetVersion() && m_Hierarchy.m_SortSourceValid)
+			{
+				// Only reordered since the cache was built, the cached slots follow their nodes.
+				auto& source = m_Hierarchy.m_SortSource;
+				m_SlotScratch.resize(source.size());
+				for (size_t i = 0; i < source.size(); ++i)
+				{
+					m_SlotScratch[i] = cache.slots[source[i]];
+				}
+				std::swap(cache.slots, m_SlotScratch);
+				cache.hierarchyVersion = m_Hierarchy.GetVersion();
+			}
+			else if (cache.hierarchyVersion != m_Hierarchy.GetVersion() || cache.slotVersion != m_HierarchySlotVersion)
+			{
+				auto& componentMap = poolIt->second.m_ComponentMap;
+				cache.slots.resize(nodes.size());
+				for (size_t i = 0; i < nodes.size(); ++i)
+				{
+					auto it = componentMap.find(nodes[i].entity);
+					cache.slots[i] = it != componentMap.end() ? it->second.data : nullptr;
+				}
+				cache.hierarchyVersion = m_Hierarchy.GetVersion();
+				cache.slotVersion = m_HierarchySlotVersion;
+			}
+
+			// The vector buffer stays put if func propagates another type and the cache map grows.
+			uint8_t* const* slots = cache.slots.data();
+			const size_t count = cache.slots.size();
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (slots[i] == nullptr) continue;
+				auto& node = nodes[i];
+				uint8_t* parent = node.parentIndex != InvalidIndex ? slots[node.parentIndex] : nullptr;
+				func(node.entity, *reinterpret_cast<TComponent*>(slots[i]), reinterpret_cast<TComponent*>(parent));
+			}
+		}
+
+		// Resources are world global values (time, input, settings) stored once per registry
+		// instead of on an entity. Setting an existing resource rebuilds it at the same address,
+		// so pointers and references stay valid until RemoveResource, unless T may throw while being
+		// moved and cannot be assigned, then the new value gets a new address. Resources with a
+		// REGISTER_COMPONENT id are written by the serializer.
+		template<class T, class ...TArgs>
+		T& SetResource(TArgs&&... args)
+		{
+			const uint32_t index = ResourceIndex::Get<T>();
+			if (index >= m_Resources.size())
+			{
+				m_Resources.resize(static_cast<size_t>(index) + 1);
+			}
+			auto& slot = m_Resources[index];
+			if (slot)
+			{
+				T& value = static_cast<Resource<T>*>(slot.get())->value;
+				if constexpr (std::is_nothrow_move_constructible_v<T>)
+				{
+					// Rebuilt in place, components carry a const hashID and cannot be assigned.
+					T replacement = Resource<T>::Make(std::forward<TArgs>(args)...);
+					value.~T();
+					return *new (&value) T(std::move(replacement));
+				}
+				else if constexpr (std::is_move_assignable_v<T>)
+				{
+					value = Resource<T>::Make(std::forward<TArgs>(args)...);
+					return value;
+				}
+				else
+				{
+					// Destroying first could leave a dead value behind if the move throws,
+					// so the old resource is only released once the new one is built.
+					slot = std::make_unique<Resource<T>>(std::forward<TArgs>(args)...);
+					return static_cast<Resource<T>*>(slot.get())->value;
+				}
+			}
+			slot = std::make_unique<Resource<T>>(std::forward<TArgs>(args)...);
+			if (!m_PendingResources.empty())
+			{
+				m_PendingResources.erase(slot->id);
+			}
+			return static_cast<Resource<T>*>(slot.get())->value;
+		}
+
+		template<class T>
+		T& GetResource()
+		{
+			T* resource = TryGetResource<T>();
+			if (resource == nullptr)
+			{
+				throw std::invalid_argument("GetResource called for a resource that is not set.");
+			}
+			return *resource;
+		}
+
+		template<class T>
+		T* TryGetResource()
+		{
+			const uint32_t index = ResourceIndex::Get<T>();
+			if (index < m_Resources.size() && m_Resources[index])
+			{
+				return &static_cast<Resource<T>*>(m_Resources[index].get())->value;
+			}
+			return AdoptPendingResource<T>();
+		}
+
+		template<class T>
+		bool HasResource()
+		{
+			return TryGetResource<T>() != nullptr;
+		}
+
+		template<class T>
+		void RemoveResource()
+		{
+			const uint32_t index = ResourceIndex::Get<T>();
+			if (index < m_Resources.size())
+			{
+				m_Resources[index].reset();
+			}
+			if constexpr (HasHashID<T>::value)
+			{
+				m_PendingResources.erase(T().hashID);
+			}
+		}
+
+		// Soft limit for the bytes of component pages. New pages are only noted, callback runs
+		// from CheckMemoryBudget if the registry is still above budget, never from inside another
+		// registry call. callback may free memory, e.g. by destroying entities and calling
+		// ShrinkToFit. Allocations are never refused, a budget of 0 disables the check.
+		void SetMemoryBudget(size_t bytes, std::function<void(Registry&, const MemoryUsage&)> callback)
+		{
+			m_MemoryBudget = bytes;
+			m_BudgetCallback = std::move(callback);
+		}
+
+		// Runs the budget callback if pages were allocated since the last check and the registry
+		// is above budget. Call it where no component references are held and no Execute is
+		// running, such as the end of a frame or after loading. Returns true if the callback ran.
+		bool CheckMemoryBudget()
+		{
+			if (!m_BudgetPending)
+			{
+				return false;
+			}
+			m_BudgetPending = false;
+			if (m_MemoryBudget == 0 || !m_BudgetCallback)
+			{
+				return false;
+			}
+			MemoryUsage usage = GetMemoryUsage();
+			if (usage.allocatedBytes <= m_MemoryBudget)
+			{
+				return false;
+			}
+			m_BudgetCallback(*this, usage);
+			return true;
+		}
+
+		MemoryUsage GetMemoryUsage() const
+		{
+			MemoryUsage total;
+			for (auto& it : m_ComponentPools)
+			{
+				MemoryUsage usage = it.second.GetMemoryUsage();
+				total.allocatedBytes += usage.allocatedBytes;
+				total.usedBytes += usage.usedBytes;
+				total.componentCount += usage.componentCount;
+			}
+			return total;
+		}
+
+		template<class TComponent>
+		MemoryUsage GetPoolMemoryUsage()
+		{
+			return MakeOrGetPool<TComponent>().GetMemoryUsage();
+		}
+
+		// Calls func(id, usage) for the pool of every component type.
+		template<class TFunction>
+		void ForEachPool(TFunction&& func) const
+		{
+			for (auto& it : m_ComponentPools)
+			{
+				func(it.first, it.second.GetMemoryUsage());
+			}
+		}
+
+		// Compacts every pool and gives its empty pages back to the memory resource.
+		// Invalidates all pointers and references to components.
+		void ShrinkToFit()
+		{
+			for (auto& it : m_ComponentPools)
+			{
+				it.second.ShrinkToFit();
+			}
+			++m_HierarchySlotVersion;
+		}
+
+		// Logs every following registry operation to recorder, nullptr stops recording.
+		// The recorder is not owned and has to outlive the registry or be detached first.
+		void SetTraceRecorder(TraceRecorder* recorder)
+		{
+			m_TraceRecorder = recorder;
+		}
+
 		template<class TFunction>
 		void ForEach(TFunction&& func)
 		{
@@ -208,6 +1002,7 @@ namespace Snowflake
 		template<class ...TComponents, class TFunction>
 		void Execute(TFunction&& func)
 		{
+			if (m_TraceRecorder) m_TraceRecorder->RecordExecute({ { TComponents().hashID, sizeof(TComponents) }... });
 			for (auto entity : m_Entities)
 			{
 				if (HasComponents<TComponents...>(entity))
@@ -218,6 +1013,34 @@ namespace Snowflake
 		}
 	private:
 
+		// Components of hierarchy nodes moved, the slots cached by PropagateHierarchy are stale.
+		void TouchHierarchySlots(Entity entity)
+		{
+			if (m_Hierarchy.Contains(entity))
+			{
+				++m_HierarchySlotVersion;
+			}
+		}
+
+		void ReleaseEntity(Entity entity)
+		{
+			uint32_t index = m_EntityIndices[entity];
+			m_Entities[index] = m_Entities.back();
+			m_EntityIndices[m_Entities[index]] = index;
+			m_Entities.pop_back();
+			m_EntityIndices[entity] = InvalidIndex;
+			m_FreeEntities.push_back(entity);
+		}
+
+		void ReleaseComponents(Entity entity)
+		{
+			while (!m_Registry[entity].empty())
+			{
+				m_ComponentPools[m_Registry[entity].back()].DeRegisterEntity(entity);
+				m_Registry[entity].pop_back();
+			}
+		}
+
 		void AddComponentFromData(std::vector<uint8_t>& data, SnowID& id, Entity entt)
 		{
 			if (entt == InvalidEntity)
@@ -225,35 +1048,127 @@ namespace Snowflake
 				throw std::invalid_argument("AddComponent called with invalid entity.");
 			}
 			
-			auto it = m_ComponentPools.find(id);
-			if (it == m_ComponentPools.end())
-			{
-				m_ComponentPools[id] = ComponentPool(id);
-				componentSizes[id] = data.size();
-			}
-			auto& pool = m_ComponentPools[id];
-			
+			auto& pool = MakeOrGetPool(id, data.size());
+			const size_t pageCount = pool.m_Pages.size();
 
 			pool.RegisterEntity(entt, data);
 			m_Registry[entt].push_back(id);
+			TouchHierarchySlots(entt);
+			if (m_TraceRecorder) m_TraceRecorder->RecordComponent(TraceOp::AddComponent, entt, id, data.size());
+			if (pool.m_Pages.size() != pageCount)
+			{
+				m_BudgetPending = true;
+			}
+		}
+
+		// Deserialized resources are kept as bytes until their type is first requested.
+		template<class T>
+		T* AdoptPendingResource()
+		{
+			if constexpr (HasHashID<T>::value)
+			{
+				if (m_PendingResources.empty()) return nullptr;
+				auto it = m_PendingResources.find(T().hashID);
+				if (it == m_PendingResources.end() || it->second.size() != sizeof(T)) return nullptr;
+				ByteSet data = std::move(it->second);
+				m_PendingResources.erase(T().hashID);
+				T& resource = SetResource<T>();
+				memcpy(m_Resources[ResourceIndex::Get<T>()]->Data(), data.data(), sizeof(T));
+				return &resource;
+			}
+			else
+			{
+				return nullptr;
+			}
+		}
+
+		void SetResourceFromData(ByteSet& data, const SnowID& id)
+		{
+			for (auto& resource : m_Resources)
+			{
+				if (resource && resource->id == id && resource->Size() == data.size())
+				{
+					memcpy(resource->Data(), data.data(), data.size());
+					return;
+				}
+			}
+			m_PendingResources[id] = data;
+		}
+
+		void RemoveComponentFromId(const SnowID& id, Entity entity)
+		{
+			auto poolIt = m_ComponentPools.find(id);
+			if (poolIt != m_ComponentPools.end())
+			{
+				poolIt->second.DeRegisterEntity(entity);
+				TouchHierarchySlots(entity);
+			}
+			auto& registry = m_Registry[entity];
+			auto it = std::find(registry.begin(), registry.end(), id);
+			if (it != registry.end())
+			{
+				registry.erase(it);
+			}
 		}
 
 		template<class TComponent>
 		ComponentPool& MakeOrGetPool()
 		{
-			SnowID hash = TComponent().hashID;
-			auto it = m_ComponentPools.find(hash);
-			if (it == m_ComponentPools.end())
+			static_assert(alignof(TComponent) <= alignof(std::max_align_t), "Over aligned components are not supported.");
+			return MakeOrGetPool(TComponent().hashID, sizeof(TComponent), alignof(TComponent));
+		}
+
+		// Pools created from an id alone assume the largest power of two dividing the size,
+		// sizeof(T) is a multiple of alignof(T) so this is never less than the real alignment.
+		ComponentPool& MakeOrGetPool(const SnowID& id, size_t componentSize)
+		{
+			size_t alignment = componentSize & (~componentSize + 1);
+			if (alignment == 0 || alignment > alignof(std::max_align_t))
+			{
+				alignment = alignof(std::max_align_t);
+			}
+			return MakeOrGetPool(id, componentSize, alignment);
+		}
+
+		ComponentPool& MakeOrGetPool(const SnowID& id, size_t componentSize, size_t alignment)
+		{
+			auto it = m_ComponentPools.find(id);
+			if (it != m_ComponentPools.end())
 			{
-				m_ComponentPools[hash] = ComponentPool(hash);
-				componentSizes[hash] = sizeof(TComponent);
+				return it->second;
 			}
-			return m_ComponentPools[hash];
+			componentSizes[id] = componentSize;
+			auto& pool = m_ComponentPools[id];
+			pool = ComponentPool(id, componentSize, alignment, m_MemoryResource);
+			return pool;
 		}
 
+		std::pmr::memory_resource* m_MemoryResource;
+		size_t m_MemoryBudget = 0;
+		std::function<void(Registry&, const MemoryUsage&)> m_BudgetCallback;
+		// Set when a pool allocated a page since the last CheckMemoryBudget.
+		bool m_BudgetPending = false;
 		std::vector<Entity> m_Entities;
-		std::unordered_map<Entity, std::vector<SnowID>> m_Registry;
-		std::unordered_map<SnowID, ComponentPool> m_ComponentPools;
+		// Position of every entity in m_Entities, InvalidIndex once destroyed.
+		std::vector<uint32_t> m_EntityIndices;
+		std::vector<Entity> m_FreeEntities;
+		FlatMap<Entity, std::vector<SnowID>> m_Registry;
+		FlatMap<SnowID, ComponentPool> m_ComponentPools;
+		struct HierarchySlots
+		{
+			// Component of every hierarchy node by node index, null where the node lacks it.
+			std::vector<uint8_t*> slots;
+			uint64_t hierarchyVersion = ~0ull;
+			uint64_t slotVersion = ~0ull;
+		};
+
+		Hierarchy m_Hierarchy;
+		FlatMap<SnowID, HierarchySlots> m_HierarchySlots;
+		uint64_t m_HierarchySlotVersion = 0;
+		std::vector<uint8_t*> m_SlotScratch;
+		TraceRecorder* m_TraceRecorder = nullptr;
+		std::vector<std::unique_ptr<ResourceBase>> m_Resources;
+		FlatMap<SnowID, ByteSet> m_PendingResources;
 
 	};
 }
\ No newline at end of file
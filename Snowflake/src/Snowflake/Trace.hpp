@@ -0,0 +1,327 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "SnowID.h"
+#include "FlatMap.hpp"
+
+namespace Snowflake
+{
+	enum class TraceOp : uint8_t
+	{
+		DefineComponent,
+		CreateEntity,
+		DestroyEntity,
+		DestroyHierarchy,
+		AddComponent,
+		RemoveComponent,
+		SetParent,
+		Execute
+	};
+
+	// Trace layout: magic and version, then one record per operation.
+	// A record is the op byte followed by LEB128 varints. Components are written as indices,
+	// the first use of a SnowID emits a DefineComponent record {index, SnowID, size}.
+	//   CreateEntity, DestroyEntity, DestroyHierarchy: entity
+	//   AddComponent, RemoveComponent: entity, component index
+	//   SetParent: child, parent
+	//   Execute: component count, component indices
+	class TraceRecorder
+	{
+	public:
+		static constexpr uint64_t Magic = 0x31435254574F4E53ull; // "SNOWTRC1"
+		static constexpr uint32_t Version = 1;
+
+		// Keeps the trace in memory, see GetData.
+		TraceRecorder()
+		{
+			WriteHeader();
+		}
+
+		// Streams the trace to filePath, flushing whenever the buffer fills up.
+		// Check IsGood to see whether the file could be opened and written.
+		explicit TraceRecorder(const std::filesystem::path& filePath)
+			: m_File(std::make_unique<std::ofstream>(filePath.string(), std::ios::out | std::ios::binary))
+		{
+			WriteHeader();
+		}
+
+		~TraceRecorder()
+		{
+			Flush();
+		}
+
+		TraceRecorder(const TraceRecorder&) = delete;
+		TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+		void RecordEntity(TraceOp op, uint32_t entity)
+		{
+			m_Data.push_back(static_cast<uint8_t>(op));
+			WriteVarint(entity);
+			FlushIfFull();
+		}
+
+		void RecordComponent(TraceOp op, uint32_t entity, const SnowID& id, size_t size)
+		{
+			uint32_t index = ComponentIndex(id, size);
+			m_Data.push_back(static_cast<uint8_t>(op));
+			WriteVarint(entity);
+			WriteVarint(index);
+			FlushIfFull();
+		}
+
+		void RecordSetParent(uint32_t child, uint32_t parent)
+		{
+			m_Data.push_back(static_cast<uint8_t>(TraceOp::SetParent));
+			WriteVarint(child);
+			WriteVarint(parent);
+			FlushIfFull();
+		}
+
+		void RecordExecute(std::initializer_list<std::pair<SnowID, size_t>> components)
+		{
+			m_Indices.clear();
+			for (auto& component : components)
+			{
+				m_Indices.push_back(ComponentIndex(component.first, component.second));
+			}
+			m_Data.push_back(static_cast<uint8_t>(TraceOp::Execute));
+			WriteVarint(m_Indices.size());
+			for (auto index : m_Indices)
+			{
+				WriteVarint(index);
+			}
+			FlushIfFull();
+		}
+
+		// Only holds the unflushed tail when streaming to a file.
+		const std::vector<uint8_t>& GetData() const
+		{
+			return m_Data;
+		}
+
+		// False once opening or writing the trace file failed, always true in memory.
+		bool IsGood() const
+		{
+			return !m_File || m_File->good();
+		}
+
+		// Only for in memory traces, a streamed trace is already in its file and the buffer
+		// holds just the unflushed tail without a header.
+		bool Save(const std::filesystem::path& filePath) const
+		{
+			if (m_File)
+			{
+				return false;
+			}
+			std::ofstream writeFile(filePath.string(), std::ios::out | std::ios::binary);
+			if (!writeFile)
+			{
+				return false;
+			}
+			writeFile.write(reinterpret_cast<const char*>(m_Data.data()), m_Data.size());
+			writeFile.close();
+			return writeFile.good();
+		}
+
+		// Returns false if the trace file could not be written, see IsGood.
+		bool Flush()
+		{
+			if (!m_File) return true;
+			m_File->write(reinterpret_cast<const char*>(m_Data.data()), m_Data.size());
+			m_File->flush();
+			m_Data.clear();
+			return m_File->good();
+		}
+
+	private:
+		static constexpr size_t FlushSize = 64 * 1024;
+
+		void WriteHeader()
+		{
+			m_Data.resize(sizeof(Magic) + sizeof(Version));
+			memcpy(m_Data.data(), &Magic, sizeof(Magic));
+			memcpy(m_Data.data() + sizeof(Magic), &Version, sizeof(Version));
+		}
+
+		void WriteVarint(uint64_t value)
+		{
+			while (value >= 0x80)
+			{
+				m_Data.push_back(static_cast<uint8_t>(value | 0x80));
+				value >>= 7;
+			}
+			m_Data.push_back(static_cast<uint8_t>(value));
+		}
+
+		uint32_t ComponentIndex(const SnowID& id, size_t size)
+		{
+			auto it = m_ComponentIndices.find(id);
+			if (it != m_ComponentIndices.end())
+			{
+				return it->second;
+			}
+			uint32_t index = static_cast<uint32_t>(m_ComponentIndices.size());
+			m_ComponentIndices[id] = index;
+			m_Data.push_back(static_cast<uint8_t>(TraceOp::DefineComponent));
+			WriteVarint(index);
+			size_t offset = m_Data.size();
+			m_Data.resize(offset + sizeof(SnowID));
+			memcpy(m_Data.data() + offset, &id, sizeof(SnowID));
+			WriteVarint(size);
+			return index;
+		}
+
+		void FlushIfFull()
+		{
+			if (m_File && m_Data.size() >= FlushSize)
+			{
+				Flush();
+			}
+		}
+
+		std::vector<uint8_t> m_Data;
+		std::vector<uint32_t> m_Indices;
+		FlatMap<SnowID, uint32_t> m_ComponentIndices;
+		std::unique_ptr<std::ofstream> m_File;
+	};
+
+	struct TraceComponent
+	{
+		SnowID id;
+		size_t size = 0;
+	};
+
+	struct TraceEvent
+	{
+		TraceOp op = TraceOp::CreateEntity;
+		uint32_t entity = 0;
+		uint32_t parent = 0;
+		std::vector<uint32_t> components;
+	};
+
+	// Reads the records written by TraceRecorder, DefineComponent records are consumed internally.
+	class TraceReader
+	{
+	public:
+		TraceReader(const uint8_t* data, size_t size) : m_Data(data), m_Size(size)
+		{
+			uint64_t magic = 0;
+			uint32_t version = 0;
+			if (size < sizeof(magic) + sizeof(version)) return;
+			memcpy(&magic, data, sizeof(magic));
+			memcpy(&version, data + sizeof(magic), sizeof(version));
+			m_Valid = magic == TraceRecorder::Magic && version == TraceRecorder::Version;
+			m_Offset = sizeof(magic) + sizeof(version);
+		}
+
+		bool IsValid() const
+		{
+			return m_Valid;
+		}
+
+		// Returns false at the end of the trace or when a record is malformed, see IsValid.
+		bool Next(TraceEvent& event)
+		{
+			while (m_Valid && m_Offset < m_Size)
+			{
+				TraceOp op = static_cast<TraceOp>(m_Data[m_Offset++]);
+				event.op = op;
+				event.components.clear();
+				uint64_t value = 0;
+				switch (op)
+				{
+				case TraceOp::DefineComponent:
+				{
+					if (!ReadVarint(value) || value != m_Components.size() || m_Size - m_Offset < sizeof(SnowID)) return Fail();
+					uint64_t hiPart = 0;
+					uint64_t loPart = 0;
+					memcpy(&hiPart, m_Data + m_Offset, sizeof(hiPart));
+					memcpy(&loPart, m_Data + m_Offset + sizeof(hiPart), sizeof(loPart));
+					m_Offset += sizeof(SnowID);
+					if (!ReadVarint(value)) return Fail();
+					m_Components.push_back(TraceComponent{ SnowID(hiPart, loPart), static_cast<size_t>(value) });
+					continue;
+				}
+				case TraceOp::CreateEntity:
+				case TraceOp::DestroyEntity:
+				case TraceOp::DestroyHierarchy:
+					return ReadEntity(event.entity) || Fail();
+				case TraceOp::AddComponent:
+				case TraceOp::RemoveComponent:
+					if (!ReadEntity(event.entity) || !ReadComponentIndex(event.components)) return Fail();
+					return true;
+				case TraceOp::SetParent:
+					return (ReadEntity(event.entity) && ReadEntity(event.parent)) || Fail();
+				case TraceOp::Execute:
+					if (!ReadVarint(value)) return Fail();
+					for (uint64_t i = 0; i < value; ++i)
+					{
+						if (!ReadComponentIndex(event.components)) return Fail();
+					}
+					return true;
+				default:
+					return Fail();
+				}
+			}
+			return false;
+		}
+
+		const TraceComponent& GetComponent(uint32_t index) const
+		{
+			return m_Components[index];
+		}
+
+		size_t GetComponentCount() const
+		{
+			return m_Components.size();
+		}
+
+	private:
+		bool Fail()
+		{
+			m_Valid = false;
+			return false;
+		}
+
+		bool ReadVarint(uint64_t& value)
+		{
+			value = 0;
+			for (uint32_t shift = 0; shift < 64; shift += 7)
+			{
+				if (m_Offset >= m_Size) return false;
+				uint8_t byte = m_Data[m_Offset++];
+				value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0) return true;
+			}
+			return false;
+		}
+
+		bool ReadEntity(uint32_t& entity)
+		{
+			uint64_t value = 0;
+			if (!ReadVarint(value) || value > UINT32_MAX) return false;
+			entity = static_cast<uint32_t>(value);
+			return true;
+		}
+
+		bool ReadComponentIndex(std::vector<uint32_t>& components)
+		{
+			uint64_t value = 0;
+			if (!ReadVarint(value) || value >= m_Components.size()) return false;
+			components.push_back(static_cast<uint32_t>(value));
+			return true;
+		}
+
+		const uint8_t* m_Data;
+		size_t m_Size;
+		size_t m_Offset = 0;
+		bool m_Valid = false;
+		std::vector<TraceComponent> m_Components;
+	};
+}
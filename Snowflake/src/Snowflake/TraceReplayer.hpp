@@ -0,0 +1,123 @@
+#pragma once
+#include "Snowflake.hpp"
+
+namespace Snowflake
+{
+	// Re-executes recorded trace events against a registry. Trace entities are mapped to the
+	// entities the registry hands out, entities the trace never created are created on first use.
+	// Replayed components are zero filled apart from their leading SnowID.
+	class TraceReplayer
+	{
+	public:
+		TraceReplayer(Registry& registry) : m_Registry(registry)
+		{
+		}
+
+		// Returns false if the event cannot be applied, e.g. destroying an entity that does not exist.
+		bool Apply(const TraceEvent& event, const TraceReader& reader)
+		{
+			switch (event.op)
+			{
+			case TraceOp::CreateEntity:
+				m_Entities[event.entity] = m_Registry.CreateEntity();
+				return true;
+			case TraceOp::DestroyEntity:
+			{
+				Entity entity = Resolve(event.entity);
+				m_Entities.erase(event.entity);
+				return m_Registry.DestroyEntity(entity);
+			}
+			case TraceOp::DestroyHierarchy:
+			{
+				Entity entity = Resolve(event.entity);
+				m_Entities.erase(event.entity);
+				return m_Registry.DestroyHierarchy(entity);
+			}
+			case TraceOp::AddComponent:
+			{
+				const auto& component = reader.GetComponent(event.components[0]);
+				m_ComponentData.assign(component.size, 0);
+				memcpy(m_ComponentData.data(), &component.id, std::min(component.size, sizeof(SnowID)));
+				SnowID id = component.id;
+				m_Registry.AddComponentFromData(m_ComponentData, id, Resolve(event.entity));
+				return true;
+			}
+			case TraceOp::RemoveComponent:
+				m_Registry.RemoveComponentFromId(reader.GetComponent(event.components[0]).id, Resolve(event.entity));
+				return true;
+			case TraceOp::SetParent:
+				try
+				{
+					if (event.parent == InvalidEntity)
+					{
+						m_Registry.RemoveParent(Resolve(event.entity));
+					}
+					else
+					{
+						m_Registry.SetParent(Resolve(event.entity), Resolve(event.parent));
+					}
+				}
+				catch (const std::invalid_argument&)
+				{
+					return false;
+				}
+				return true;
+			case TraceOp::Execute:
+				Execute(event, reader);
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// Sum of the first byte of every component visited by replayed Execute calls.
+		uint64_t GetChecksum() const
+		{
+			return m_Checksum;
+		}
+
+	private:
+		Entity Resolve(uint32_t traceEntity)
+		{
+			auto it = m_Entities.find(traceEntity);
+			if (it != m_Entities.end())
+			{
+				return it->second;
+			}
+			Entity entity = m_Registry.CreateEntity();
+			m_Entities[traceEntity] = entity;
+			return entity;
+		}
+
+		// Mirrors Registry::Execute with IDs instead of types.
+		void Execute(const TraceEvent& event, const TraceReader& reader)
+		{
+			for (auto index : event.components)
+			{
+				const auto& component = reader.GetComponent(index);
+				m_Registry.MakeOrGetPool(component.id, component.size);
+			}
+			m_Pools.clear();
+			for (auto index : event.components)
+			{
+				m_Pools.push_back(&m_Registry.m_ComponentPools[reader.GetComponent(index).id]);
+			}
+
+			for (auto entity : m_Registry.m_Entities)
+			{
+				bool matches = std::all_of(m_Pools.begin(), m_Pools.end(), [&](ComponentPool* pool) { return pool->IsEntityRegistered(entity); });
+				if (!matches) continue;
+				for (auto pool : m_Pools)
+				{
+					m_Checksum += pool->GetComponent<uint8_t>(entity);
+				}
+			}
+		}
+
+		Registry& m_Registry;
+		FlatMap<uint32_t, Entity> m_Entities;
+		std::vector<uint8_t> m_ComponentData;
+		std::vector<ComponentPool*> m_Pools;
+		uint64_t m_Checksum = 0;
+	};
+}
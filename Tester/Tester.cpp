@@ -1,7 +1,9 @@
 #include "pch.h"
 #include "CppUnitTest.h"
 #include "Snowflake/Serializer.hpp"
+#include "Snowflake/Memory.hpp"
 #include "Snowflake/Snowflake.hpp"
+#include "Snowflake/TraceReplayer.hpp"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -215,6 +217,388 @@ namespace Tester
 		}
 
 	};
+	TEST_CLASS(EntityHierarchy)
+	{
+	public:
+		TEST_METHOD(SetParent)
+		{
+			Snowflake::Registry registry;
+			auto root = registry.CreateEntity();
+			auto child = registry.CreateEntity();
+			auto child2 = registry.CreateEntity();
+			registry.SetParent(child, root);
+			registry.SetParent(child2, root);
+			Assert::AreEqual(root, registry.GetParent(child));
+			Assert::AreEqual(child2, registry.GetFirstChild(root));
+			Assert::AreEqual(child, registry.GetNextSibling(child2));
+			registry.RemoveParent(child2);
+			Assert::AreEqual(Snowflake::InvalidEntity, registry.GetParent(child2));
+			Assert::AreEqual(child, registry.GetFirstChild(root));
+		}
+
+		TEST_METHOD(ReparentKeepsDepthOrder)
+		{
+			Snowflake::Registry registry;
+			auto a = registry.CreateEntity();
+			auto b = registry.CreateEntity();
+			auto c = registry.CreateEntity();
+			auto d = registry.CreateEntity();
+			registry.SetParent(b, a);
+			registry.SetParent(c, b);
+			registry.SetParent(a, d);
+			registry.SetParent(c, d);
+			auto& nodes = registry.GetHierarchy().GetNodes();
+			for (size_t i = 1; i < nodes.size(); ++i)
+			{
+				Assert::IsTrue(nodes[i - 1].depth <= nodes[i].depth);
+			}
+			Assert::AreEqual(2u, registry.GetHierarchy().GetNode(b)->depth);
+			Assert::AreEqual(1u, registry.GetHierarchy().GetNode(c)->depth);
+		}
+
+		TEST_METHOD(SetParentRejectsDeadEntities)
+		{
+			Snowflake::Registry registry;
+			auto root = registry.CreateEntity();
+			auto child = registry.CreateEntity();
+			auto dead = registry.CreateEntity();
+			registry.DestroyEntity(dead);
+			Assert::ExpectException<std::invalid_argument>([&]() { registry.SetParent(child, 0xFFFFFFF0); });
+			Assert::ExpectException<std::invalid_argument>([&]() { registry.SetParent(root, 2); });
+			registry.SetParent(child, root);
+			registry.DestroyEntity(root);
+			Assert::AreEqual(Snowflake::InvalidEntity, registry.GetParent(child));
+			Assert::AreEqual(size_t(1), registry.GetHierarchy().GetNodes().size());
+		}
+
+		TEST_METHOD(PropagateHierarchy)
+		{
+			Snowflake::Registry registry;
+			auto root = registry.CreateEntity();
+			auto child = registry.CreateEntity();
+			auto grandChild = registry.CreateEntity();
+			registry.AddComponent<TransformComponent>(root).x = 1.f;
+			registry.AddComponent<TransformComponent>(child).x = 2.f;
+			registry.AddComponent<TransformComponent>(grandChild).x = 3.f;
+			registry.SetParent(grandChild, child);
+			registry.SetParent(child, root);
+			registry.PropagateHierarchy<TransformComponent>([](Snowflake::Entity, TransformComponent& transform, TransformComponent* parent) {
+				transform.y = transform.x + (parent ? parent->y : 0.f);
+				});
+			Assert::AreEqual(6.f, registry.GetComponent<TransformComponent>(grandChild).y);
+		}
+
+		TEST_METHOD(PropagateAfterChanges)
+		{
+			Snowflake::Registry registry;
+			auto root = registry.CreateEntity();
+			auto child = registry.CreateEntity();
+			auto grandChild = registry.CreateEntity();
+			auto other = registry.CreateEntity();
+			registry.SetParent(child, root);
+			registry.SetParent(grandChild, child);
+			registry.SetParent(other, root);
+			for (auto entity : { root, child, grandChild, other })
+			{
+				registry.AddComponent<TransformComponent>(entity).x = 1.f;
+			}
+			auto propagate = [&]() {
+				registry.PropagateHierarchy<TransformComponent>([](Snowflake::Entity, TransformComponent& transform, TransformComponent* parent) {
+					transform.y = transform.x + (parent ? parent->y : 0.f);
+					});
+			};
+			propagate();
+			Assert::AreEqual(3.f, registry.GetComponent<TransformComponent>(grandChild).y);
+
+			registry.RemoveComponent<TransformComponent>(child);
+			propagate();
+			Assert::AreEqual(1.f, registry.GetComponent<TransformComponent>(grandChild).y);
+
+			registry.AddComponent<TransformComponent>(child).x = 5.f;
+			registry.SetParent(grandChild, other);
+			propagate();
+			Assert::AreEqual(3.f, registry.GetComponent<TransformComponent>(grandChild).y);
+
+			registry.DestroyEntity(other);
+			registry.ShrinkToFit();
+			propagate();
+			Assert::AreEqual(1.f, registry.GetComponent<TransformComponent>(grandChild).y);
+			Assert::AreEqual(6.f, registry.GetComponent<TransformComponent>(child).y);
+		}
+
+		TEST_METHOD(DestroyHierarchy)
+		{
+			Snowflake::Registry registry;
+			auto root = registry.CreateEntity();
+			auto child = registry.CreateEntity();
+			auto grandChild = registry.CreateEntity();
+			auto other = registry.CreateEntity();
+			registry.SetParent(child, root);
+			registry.SetParent(grandChild, child);
+			registry.AddComponent<TransformComponent>(grandChild);
+			Assert::IsTrue(registry.DestroyHierarchy(root));
+			Assert::AreEqual(Snowflake::InvalidEntity, root);
+			Assert::IsFalse(registry.ValidateEntity(child));
+			Assert::IsFalse(registry.ValidateEntity(grandChild));
+			Assert::IsTrue(registry.ValidateEntity(other));
+			Assert::AreEqual(size_t(0), registry.GetHierarchy().GetNodes().size());
+		}
+	};
+	TEST_CLASS(FlatMapHandling)
+	{
+	public:
+		TEST_METHOD(InsertFindErase)
+		{
+			Snowflake::FlatMap<Snowflake::Entity, int> map;
+			for (Snowflake::Entity entity = 0; entity < 1000; ++entity)
+			{
+				map[entity] = static_cast<int>(entity) * 2;
+			}
+			Assert::AreEqual(size_t(1000), map.size());
+			for (Snowflake::Entity entity = 0; entity < 1000; entity += 2)
+			{
+				Assert::AreEqual(size_t(1), map.erase(entity));
+			}
+			Assert::AreEqual(size_t(500), map.size());
+			Assert::IsTrue(map.find(10) == map.end());
+			Assert::AreEqual(22, map.find(11)->second);
+			size_t visited = 0;
+			for (auto& it : map)
+			{
+				Assert::AreEqual(static_cast<int>(it.first) * 2, it.second);
+				++visited;
+			}
+			Assert::AreEqual(size_t(500), visited);
+		}
+
+		TEST_METHOD(SnowIDHashSpreadsMirroredHalves)
+		{
+			Snowflake::FlatMap<SnowID, size_t> map;
+			for (uint64_t i = 0; i < 1024; ++i)
+			{
+				map[SnowID(i, i)] = i;
+			}
+			Assert::IsTrue(std::hash<SnowID>()(SnowID(1, 1)) != std::hash<SnowID>()(SnowID(2, 2)));
+			Assert::IsTrue(map.GetProbeStats().maxProbeLength < 32);
+		}
+	};
+	TEST_CLASS(Tracing)
+	{
+	public:
+		TEST_METHOD(RecordAndReplay)
+		{
+			Snowflake::TraceRecorder recorder;
+			{
+				Snowflake::Registry registry;
+				registry.SetTraceRecorder(&recorder);
+				auto parent = registry.CreateEntity();
+				auto child = registry.CreateEntity();
+				registry.AddComponent<TransformComponent>(parent);
+				registry.AddComponent<TransformComponent>(child);
+				registry.AddComponent<TestComponent>(child);
+				registry.SetParent(child, parent);
+				registry.Execute<TransformComponent, TestComponent>([](Snowflake::Entity, TransformComponent&, TestComponent&) {});
+				registry.RemoveComponent<TestComponent>(child);
+				registry.DestroyEntity(parent);
+				registry.SetTraceRecorder(nullptr);
+			}
+
+			Snowflake::TraceReader reader(recorder.GetData().data(), recorder.GetData().size());
+			Snowflake::Registry registry;
+			Snowflake::TraceReplayer replayer(registry);
+			Snowflake::TraceEvent event;
+			std::vector<Snowflake::TraceOp> ops;
+			while (reader.Next(event))
+			{
+				Assert::IsTrue(replayer.Apply(event, reader));
+				ops.push_back(event.op);
+			}
+			Assert::IsTrue(reader.IsValid());
+			Assert::AreEqual(size_t(9), ops.size());
+			Assert::AreEqual(size_t(2), reader.GetComponentCount());
+			Assert::IsTrue(ops[6] == Snowflake::TraceOp::Execute);
+
+			std::vector<Snowflake::Entity> entities;
+			registry.ForEach([&](auto entity) { entities.push_back(entity); });
+			Assert::AreEqual(size_t(1), entities.size());
+			Assert::IsTrue(registry.HasComponent<TransformComponent>(entities[0]));
+			Assert::IsFalse(registry.HasComponent<TestComponent>(entities[0]));
+		}
+
+		TEST_METHOD(FileRecorderReportsErrors)
+		{
+			Snowflake::TraceRecorder missing("missing_directory/Trace.trc");
+			Assert::IsFalse(missing.IsGood());
+			Assert::IsFalse(missing.Flush());
+
+			Snowflake::TraceRecorder streamed("Streamed.trc");
+			streamed.RecordEntity(Snowflake::TraceOp::CreateEntity, 0);
+			Assert::IsTrue(streamed.IsGood());
+			Assert::IsFalse(streamed.Save("Tail.trc"));
+			Assert::IsTrue(streamed.Flush());
+		}
+	};
+	struct TimeResource
+	{
+		float delta = 0;
+		uint64_t frame = 0;
+	};
+
+	// Moving may throw and the const member rules out assignment.
+	struct ThrowingResource
+	{
+		const int value;
+
+		ThrowingResource(int value) : value(value)
+		{
+			if (value < 0) throw std::invalid_argument("Negative value.");
+		}
+
+		ThrowingResource(ThrowingResource&& other) noexcept(false) : value(other.value)
+		{
+		}
+	};
+
+	TEST_CLASS(Resources)
+	{
+	public:
+
+		TEST_METHOD(SetAndGetResource)
+		{
+			Snowflake::Registry registry;
+			Assert::IsFalse(registry.HasResource<TimeResource>());
+			Assert::ExpectException<std::invalid_argument>([&]() { registry.GetResource<TimeResource>(); });
+
+			TimeResource* time = &registry.SetResource<TimeResource>(0.5f, uint64_t(1));
+			Assert::AreEqual(0.5f, registry.GetResource<TimeResource>().delta);
+			registry.SetResource<TimeResource>(0.25f, uint64_t(2));
+			Assert::IsTrue(time == registry.TryGetResource<TimeResource>());
+			Assert::AreEqual(uint64_t(2), time->frame);
+
+			registry.SetResource<TransformComponent>().x = 3.f;
+			Assert::AreEqual(3.f, registry.GetResource<TransformComponent>().x);
+			registry.RemoveResource<TimeResource>();
+			Assert::IsFalse(registry.HasResource<TimeResource>());
+			Assert::IsTrue(registry.HasResource<TransformComponent>());
+		}
+
+		TEST_METHOD(ReplaceResourceThatThrows)
+		{
+			Snowflake::Registry registry;
+			registry.SetResource<ThrowingResource>(1);
+			Assert::ExpectException<std::invalid_argument>([&]() { registry.SetResource<ThrowingResource>(-1); });
+			Assert::AreEqual(1, registry.GetResource<ThrowingResource>().value);
+			Assert::AreEqual(2, registry.SetResource<ThrowingResource>(2).value);
+			Assert::AreEqual(2, registry.GetResource<ThrowingResource>().value);
+		}
+	};
+	TEST_CLASS(MemoryHandling)
+	{
+	public:
+
+		TEST_METHOD(AccountingAndShrinkToFit)
+		{
+			Snowflake::Registry registry;
+			std::vector<Snowflake::Entity> entities;
+			for (int i = 0; i < 4000; ++i)
+			{
+				entities.push_back(registry.CreateEntity());
+				registry.AddComponent<TransformComponent>(entities.back()).x = static_cast<float>(i);
+			}
+			auto usage = registry.GetPoolMemoryUsage<TransformComponent>();
+			Assert::AreEqual(size_t(4000), usage.componentCount);
+			Assert::AreEqual(4000 * sizeof(TransformComponent), usage.usedBytes);
+			Assert::IsTrue(usage.allocatedBytes >= usage.usedBytes);
+			// Slots are packed at the component's own alignment, only the last page is partly empty.
+			Assert::IsTrue(usage.allocatedBytes - usage.usedBytes < Snowflake::PoolPageSize);
+
+			for (int i = 0; i < 4000; ++i)
+			{
+				if (i % 10 != 0) registry.DestroyEntity(entities[i]);
+			}
+			Assert::AreEqual(usage.allocatedBytes, registry.GetMemoryUsage().allocatedBytes);
+			registry.ShrinkToFit();
+			Assert::IsTrue(registry.GetMemoryUsage().allocatedBytes * 5 < usage.allocatedBytes);
+			Assert::AreEqual(size_t(400), registry.GetMemoryUsage().componentCount);
+			Assert::AreEqual(3990.f, registry.GetComponent<TransformComponent>(entities[3990]).x);
+		}
+
+		TEST_METHOD(MemoryBudgetCallback)
+		{
+			Snowflake::Registry registry;
+			size_t calls = 0;
+			registry.SetMemoryBudget(Snowflake::PoolPageSize, [&](Snowflake::Registry& owner, const Snowflake::MemoryUsage& usage)
+				{
+					Assert::IsTrue(usage.allocatedBytes > Snowflake::PoolPageSize);
+					owner.ShrinkToFit();
+					++calls;
+				});
+			Assert::IsFalse(registry.CheckMemoryBudget());
+			for (int frame = 0; frame < 20; ++frame)
+			{
+				for (int i = 0; i < 100; ++i)
+				{
+					registry.AddComponent<TestComponent>(registry.CreateEntity()).a = 1.f;
+				}
+				registry.CheckMemoryBudget();
+			}
+			Assert::IsTrue(calls > 0);
+			registry.Execute<TestComponent>([](auto, TestComponent& test) { Assert::AreEqual(1.f, test.a); });
+		}
+
+		TEST_METHOD(MemoryBudgetWaitsForCheck)
+		{
+			Snowflake::Registry registry;
+			size_t calls = 0;
+			registry.SetMemoryBudget(1, [&](Snowflake::Registry& owner, const Snowflake::MemoryUsage&)
+				{
+					owner.ShrinkToFit();
+					++calls;
+				});
+			std::vector<Snowflake::Entity> entities;
+			for (int i = 0; i < 2000; ++i)
+			{
+				entities.push_back(registry.CreateEntity());
+				registry.AddComponent<TestComponent>(entities.back());
+			}
+			// The kept component sits on the last page, compaction would move it.
+			const Snowflake::Entity keptEntity = registry.CreateEntity();
+			TestComponent& kept = registry.AddComponent<TestComponent>(keptEntity);
+			for (auto entity : entities)
+			{
+				registry.DestroyEntity(entity);
+			}
+			registry.AddComponent<TestComponent>(registry.CreateEntity());
+			registry.AddComponent<TestComponent>(registry.CreateEntity());
+			kept.a = 5.f;
+			Assert::AreEqual(size_t(0), calls);
+
+			Assert::IsTrue(registry.CheckMemoryBudget());
+			Assert::AreEqual(size_t(1), calls);
+			Assert::AreEqual(5.f, registry.GetComponent<TestComponent>(keptEntity).a);
+			Assert::IsFalse(registry.CheckMemoryBudget());
+		}
+
+		TEST_METHOD(PageResourceBacksPools)
+		{
+			Snowflake::PageResource pages;
+			{
+				Snowflake::Registry registry(&pages);
+				for (int i = 0; i < 3000; ++i)
+				{
+					auto entity = registry.CreateEntity();
+					registry.AddComponent<TransformComponent>(entity).y = 2.f;
+					registry.AddComponent<TestComponent>(entity);
+				}
+				Assert::AreEqual(registry.GetMemoryUsage().allocatedBytes, pages.GetAllocatedBytes());
+				Assert::AreEqual(2.f, registry.GetComponent<TransformComponent>(2999).y);
+			}
+			Assert::AreEqual(size_t(0), pages.GetAllocatedBytes());
+			Assert::IsTrue(pages.GetMappedBytes() > 0);
+			pages.Trim();
+			Assert::AreEqual(size_t(0), pages.GetMappedBytes());
+		}
+	};
 	TEST_CLASS(Serialization)
 	{
 	public:
@@ -280,5 +664,77 @@ namespace Tester
 				
 			}
 		}
+
+		TEST_METHOD(ReadAndWriteCompressed)
+		{
+			{
+				Snowflake::Registry registry;
+				for (int i = 0; i < 2000; ++i)
+				{
+					auto ent = registry.CreateEntity();
+					registry.AddComponent<TransformComponent>(ent).x = static_cast<float>(i);
+					registry.AddComponent<TestComponent>(ent).a = 2.f;
+				}
+				Snowflake::CompressionSettings settings;
+				settings.filter = Snowflake::CompressionFilter::Xor;
+				settings.blockSize = 4096;
+				Snowflake::RegistrySerializer serializer(registry);
+				Assert::IsTrue(serializer.Serialize("Compressed.ett", settings));
+				Assert::IsTrue(serializer.Serialize("Uncompressed.ett"));
+			}
+			Assert::IsTrue(std::filesystem::file_size("Compressed.ett") < std::filesystem::file_size("Uncompressed.ett") / 4);
+			{
+				Snowflake::Registry registry;
+				Snowflake::RegistrySerializer serializer(registry);
+				Assert::IsTrue(serializer.Deserialize("Compressed.ett"));
+				std::vector<Snowflake::Entity> Entities;
+				registry.ForEach([&](auto entity) { Entities.push_back(entity); });
+				Assert::AreEqual(size_t(2000), Entities.size());
+				Assert::AreEqual(1234.f, registry.GetComponent<TransformComponent>(Entities[1234]).x);
+				Assert::AreEqual(2.f, registry.GetComponent<TestComponent>(Entities[1999]).a);
+			}
+		}
+
+		TEST_METHOD(ReadAndWriteResources)
+		{
+			{
+				Snowflake::Registry registry;
+				registry.AddComponent<TestComponent>(registry.CreateEntity()).a = 1.f;
+				registry.SetResource<TransformComponent>().y = 7.f;
+				registry.SetResource<TimeResource>().frame = 9;
+				Snowflake::RegistrySerializer serializer(registry);
+				Assert::IsTrue(serializer.Serialize("Resources.ett"));
+			}
+			Snowflake::Registry registry;
+			Snowflake::RegistrySerializer serializer(registry);
+			Assert::IsTrue(serializer.Deserialize("Resources.ett"));
+			Assert::AreEqual(7.f, registry.GetResource<TransformComponent>().y);
+			Assert::IsFalse(registry.HasResource<TimeResource>());
+		}
+
+		TEST_METHOD(RejectCorruptedCompressedFile)
+		{
+			{
+				Snowflake::Registry registry;
+				for (int i = 0; i < 100; ++i)
+				{
+					registry.AddComponent<TransformComponent>(registry.CreateEntity()).x = static_cast<float>(i);
+				}
+				Snowflake::RegistrySerializer serializer(registry);
+				Assert::IsTrue(serializer.Serialize("Corrupted.ett", Snowflake::CompressionSettings()));
+			}
+			{
+				std::fstream file("Corrupted.ett", std::ios::in | std::ios::out | std::ios::binary);
+				file.seekg(-8, std::ios::end);
+				char byte = 0;
+				file.read(&byte, 1);
+				byte ^= 0x5A;
+				file.seekp(-8, std::ios::end);
+				file.write(&byte, 1);
+			}
+			Snowflake::Registry registry;
+			Snowflake::RegistrySerializer serializer(registry);
+			Assert::IsFalse(serializer.Deserialize("Corrupted.ett"));
+		}
 	};
 }
\ No newline at end of file